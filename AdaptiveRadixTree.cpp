@@ -0,0 +1,318 @@
+#include "AdaptiveRadixTree.h"
+
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+AdaptiveRadixTree::AdaptiveRadixTree() : root_(NULL), size_(0), bytes_(0) {}
+
+AdaptiveRadixTree::~AdaptiveRadixTree() {
+    destroy(root_);
+}
+
+bool AdaptiveRadixTree::isLeaf(const void* p) {
+    return (reinterpret_cast<uintptr_t>(p) & 1) != 0;
+}
+
+AdaptiveRadixTree::Leaf* AdaptiveRadixTree::asLeaf(const void* p) {
+    return reinterpret_cast<Leaf*>(reinterpret_cast<uintptr_t>(p) & ~(uintptr_t)1);
+}
+
+void* AdaptiveRadixTree::tagLeaf(Leaf* l) {
+    return reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(l) | 1);
+}
+
+AdaptiveRadixTree::Leaf* AdaptiveRadixTree::newLeaf(const string& k, int c) {
+    Leaf* l = new Leaf;
+    l->key = k;
+    l->count = c;
+    size_++;
+    bytes_ += sizeof(Leaf);
+    return l;
+}
+
+AdaptiveRadixTree::Inner* AdaptiveRadixTree::newNode(NodeType type) {
+    Inner* n;
+    if (type == kNode4) {
+        n = new Node4();
+        bytes_ += sizeof(Node4);
+    } else if (type == kNode16) {
+        n = new Node16();
+        bytes_ += sizeof(Node16);
+    } else if (type == kNode48) {
+        n = new Node48();
+        bytes_ += sizeof(Node48);
+    } else {
+        n = new Node256();
+        bytes_ += sizeof(Node256);
+    }
+    n->type = type;
+    n->children = 0;
+    n->terminal = NULL;
+    return n;
+}
+
+void AdaptiveRadixTree::destroy(void* p) {
+    if (p == NULL) {
+        return;
+    }
+    if (isLeaf(p)) {
+        delete asLeaf(p);
+        return;
+    }
+    Inner* n = static_cast<Inner*>(p);
+    delete n->terminal;
+    if (n->type == kNode4) {
+        Node4* n4 = static_cast<Node4*>(n);
+        for (int i = 0; i < n->children; i++) {
+            destroy(n4->child[i]);
+        }
+        delete n4;
+    } else if (n->type == kNode16) {
+        Node16* n16 = static_cast<Node16*>(n);
+        for (int i = 0; i < n->children; i++) {
+            destroy(n16->child[i]);
+        }
+        delete n16;
+    } else if (n->type == kNode48) {
+        Node48* n48 = static_cast<Node48*>(n);
+        for (int i = 0; i < n->children; i++) {
+            destroy(n48->child[i]);
+        }
+        delete n48;
+    } else {
+        Node256* n256 = static_cast<Node256*>(n);
+        for (int b = 0; b < 256; b++) {
+            destroy(n256->child[b]);
+        }
+        delete n256;
+    }
+}
+
+// the slot holding the child for byte b, or NULL
+void* const* AdaptiveRadixTree::findChild(const Inner* n, unsigned char b) {
+    if (n->type == kNode4) {
+        const Node4* n4 = static_cast<const Node4*>(n);
+        for (int i = 0; i < n->children; i++) {
+            if (n4->keys[i] == b) {
+                return &n4->child[i];
+            }
+        }
+    } else if (n->type == kNode16) {
+        const Node16* n16 = static_cast<const Node16*>(n);
+#ifdef __SSE2__
+        __m128i keys = _mm_loadu_si128(reinterpret_cast<const __m128i*>(n16->keys));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(keys, _mm_set1_epi8((char)b))) & ((1 << n->children) - 1);
+        if (mask != 0) {
+            return &n16->child[__builtin_ctz(mask)];
+        }
+#else
+        for (int i = 0; i < n->children; i++) {
+            if (n16->keys[i] == b) {
+                return &n16->child[i];
+            }
+        }
+#endif
+    } else if (n->type == kNode48) {
+        const Node48* n48 = static_cast<const Node48*>(n);
+        if (n48->index[b] != 0) {
+            return &n48->child[n48->index[b] - 1];
+        }
+    } else {
+        const Node256* n256 = static_cast<const Node256*>(n);
+        if (n256->child[b] != NULL) {
+            return &n256->child[b];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Moves full node n's children into the next larger layout and frees n.
+ */
+AdaptiveRadixTree::Inner* AdaptiveRadixTree::grow(Inner* n) {
+    Inner* bigger;
+    if (n->type == kNode4) {
+        Node4* n4 = static_cast<Node4*>(n);
+        Node16* n16 = static_cast<Node16*>(newNode(kNode16));
+        memcpy(n16->keys, n4->keys, sizeof(n4->keys));
+        memcpy(n16->child, n4->child, sizeof(n4->child));
+        bigger = n16;
+        bytes_ -= sizeof(Node4);
+    } else if (n->type == kNode16) {
+        Node16* n16 = static_cast<Node16*>(n);
+        Node48* n48 = static_cast<Node48*>(newNode(kNode48));
+        for (int i = 0; i < 16; i++) {
+            n48->index[n16->keys[i]] = (unsigned char)(i + 1);
+            n48->child[i] = n16->child[i];
+        }
+        bigger = n48;
+        bytes_ -= sizeof(Node16);
+    } else {
+        Node48* n48 = static_cast<Node48*>(n);
+        Node256* n256 = static_cast<Node256*>(newNode(kNode256));
+        for (int b = 0; b < 256; b++) {
+            if (n48->index[b] != 0) {
+                n256->child[b] = n48->child[n48->index[b] - 1];
+            }
+        }
+        bigger = n256;
+        bytes_ -= sizeof(Node48);
+    }
+    bigger->children = n->children;
+    bigger->prefix.swap(n->prefix);
+    bigger->terminal = n->terminal;
+    if (n->type == kNode4) {
+        delete static_cast<Node4*>(n);
+    } else if (n->type == kNode16) {
+        delete static_cast<Node16*>(n);
+    } else {
+        delete static_cast<Node48*>(n);
+    }
+    return bigger;
+}
+
+/**
+ * Adds child under byte b of the inner node at *ref, which has none yet,
+ * replacing the node with a larger one if it is full.
+ */
+void AdaptiveRadixTree::addChild(void** ref, unsigned char b, void* child) {
+    Inner* n = static_cast<Inner*>(*ref);
+    if ((n->type == kNode4 && n->children == 4) || (n->type == kNode16 && n->children == 16)
+        || (n->type == kNode48 && n->children == 48)) {
+        n = grow(n);
+        *ref = n;
+    }
+    if (n->type == kNode4 || n->type == kNode16) {
+        unsigned char* keys = n->type == kNode4 ? static_cast<Node4*>(n)->keys : static_cast<Node16*>(n)->keys;
+        void** children = n->type == kNode4 ? static_cast<Node4*>(n)->child : static_cast<Node16*>(n)->child;
+        int i = n->children;
+        while (i > 0 && keys[i - 1] > b) {
+            keys[i] = keys[i - 1];  // keep the bytes sorted for in-order walks
+            children[i] = children[i - 1];
+            i--;
+        }
+        keys[i] = b;
+        children[i] = child;
+    } else if (n->type == kNode48) {
+        Node48* n48 = static_cast<Node48*>(n);
+        n48->child[n->children] = child;  // nothing is removed, so the slots in use are dense
+        n48->index[b] = (unsigned char)(n->children + 1);
+    } else {
+        static_cast<Node256*>(n)->child[b] = child;
+    }
+    n->children++;
+}
+
+void AdaptiveRadixTree::add(const string& k, int c) {
+    void** ref = &root_;
+    size_t depth = 0;  // bytes of k matched on the way to *ref
+    while (true) {
+        void* p = *ref;
+        if (p == NULL) {
+            *ref = tagLeaf(newLeaf(k, c));
+            return;
+        }
+        if (isLeaf(p)) {
+            Leaf* l = asLeaf(p);
+            if (l->key == k) {
+                l->count += c;
+                return;
+            }
+            // expand: a new node holds both words below the bytes they share
+            size_t common = depth;
+            while (common < l->key.length() && common < k.length() && l->key[common] == k[common]) {
+                common++;
+            }
+            Inner* n = newNode(kNode4);
+            n->prefix.assign(k, depth, common - depth);
+            *ref = n;
+            if (common == l->key.length()) {
+                n->terminal = l;
+            } else {
+                addChild(ref, (unsigned char)l->key[common], p);
+            }
+            if (common == k.length()) {
+                n->terminal = newLeaf(k, c);
+            } else {
+                addChild(ref, (unsigned char)k[common], tagLeaf(newLeaf(k, c)));
+            }
+            return;
+        }
+
+        Inner* n = static_cast<Inner*>(p);
+        size_t m = 0;
+        while (m < n->prefix.length() && depth + m < k.length() && n->prefix[m] == k[depth + m]) {
+            m++;
+        }
+        if (m < n->prefix.length()) {
+            // k leaves the prefix: split it, n keeps the part after the branch byte
+            Inner* up = newNode(kNode4);
+            up->prefix.assign(n->prefix, 0, m);
+            unsigned char b = (unsigned char)n->prefix[m];
+            n->prefix.erase(0, m + 1);
+            *ref = up;
+            addChild(ref, b, n);
+            if (depth + m == k.length()) {
+                up->terminal = newLeaf(k, c);
+            } else {
+                addChild(ref, (unsigned char)k[depth + m], tagLeaf(newLeaf(k, c)));
+            }
+            return;
+        }
+        depth += m;
+        if (depth == k.length()) {
+            if (n->terminal != NULL) {
+                n->terminal->count += c;
+            } else {
+                n->terminal = newLeaf(k, c);
+            }
+            return;
+        }
+        void* const* next = findChild(n, (unsigned char)k[depth]);
+        if (next == NULL) {
+            addChild(ref, (unsigned char)k[depth], tagLeaf(newLeaf(k, c)));
+            return;
+        }
+        ref = const_cast<void**>(next);
+        depth++;
+    }
+}
+
+int AdaptiveRadixTree::count(const string& k) const {
+    const void* p = root_;
+    size_t depth = 0;
+    while (p != NULL) {
+        if (isLeaf(p)) {
+            const Leaf* l = asLeaf(p);
+            return l->key == k ? l->count : 0;
+        }
+        const Inner* n = static_cast<const Inner*>(p);
+        size_t len = n->prefix.length();
+        if (k.length() - depth < len || k.compare(depth, len, n->prefix) != 0) {
+            return 0;
+        }
+        depth += len;
+        if (depth == k.length()) {
+            return n->terminal != NULL ? n->terminal->count : 0;
+        }
+        void* const* next = findChild(n, (unsigned char)k[depth]);
+        if (next == NULL) {
+            return 0;
+        }
+        p = *next;
+        depth++;
+    }
+    return 0;
+}
+
+size_t AdaptiveRadixTree::size() const {
+    return size_;
+}
+
+size_t AdaptiveRadixTree::bytes() const {
+    return bytes_;
+}
@@ -0,0 +1,133 @@
+#ifndef ADAPTIVERADIXTREE_H
+#define ADAPTIVERADIXTREE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * An adaptive radix tree (ART) counting words. Each inner node branches on
+ * one byte of the key, so a lookup costs one step per byte instead of
+ * log n string compares, and the words come out in byte order like an
+ * AVLTree's.
+ *
+ * Inner nodes grow through four layouts as children are added: Node4 and
+ * Node16 keep sorted key bytes next to their children (Node16 is searched
+ * 16 bytes at once with SSE2), Node48 maps every byte to one of 48 slots,
+ * and Node256 indexes its children directly. A chain of nodes with one
+ * child each is collapsed into the prefix of the node below it (path
+ * compression), and a word is kept in a leaf as high in the tree as it
+ * can be until another word needs to branch past it (lazy expansion).
+ * A word that ends at an inner node is its terminal leaf.
+ */
+class AdaptiveRadixTree {
+public:
+    AdaptiveRadixTree();
+    ~AdaptiveRadixTree();
+
+    void add(const std::string& k, int c = 1);
+    int count(const std::string& k) const;
+    size_t size() const;   // number of words
+    size_t bytes() const;  // node and leaf structs
+    template<typename F>
+    void forEach(F f) const;  // calls f(word, count) in byte order
+
+private:
+    enum NodeType { kNode4, kNode16, kNode48, kNode256 };
+    struct Leaf {
+        std::string key;
+        int count;
+    };
+    struct Inner {
+        unsigned char type;
+        uint16_t children;
+        std::string prefix;  // bytes every key below shares after the parent's branch byte
+        Leaf* terminal;      // the word ending right after prefix, if any
+    };
+    struct Node4 : Inner {
+        unsigned char keys[4];  // sorted
+        void* child[4];
+    };
+    struct Node16 : Inner {
+        unsigned char keys[16];  // sorted
+        void* child[16];
+    };
+    struct Node48 : Inner {
+        unsigned char index[256];  // slot + 1 of each byte's child, 0 for none
+        void* child[48];
+    };
+    struct Node256 : Inner {
+        void* child[256];
+    };
+
+    AdaptiveRadixTree(const AdaptiveRadixTree&);
+    AdaptiveRadixTree& operator=(const AdaptiveRadixTree&);
+
+    // children are tagged pointers, leaves have the low bit set
+    static bool isLeaf(const void* p);
+    static Leaf* asLeaf(const void* p);
+    static void* tagLeaf(Leaf* l);
+
+    Leaf* newLeaf(const std::string& k, int c);
+    Inner* newNode(NodeType type);
+    void destroy(void* p);
+    static void* const* findChild(const Inner* n, unsigned char b);
+    void addChild(void** ref, unsigned char b, void* child);
+    Inner* grow(Inner* n);
+    template<typename F>
+    static void walk(const void* p, F& f);
+
+    void* root_;
+    size_t size_;
+    size_t bytes_;
+};
+
+template<typename F>
+void AdaptiveRadixTree::forEach(F f) const {
+    if (root_ != NULL) {
+        walk(root_, f);
+    }
+}
+
+/**
+ * Recursion is bounded by the length of the longest word.
+ */
+template<typename F>
+void AdaptiveRadixTree::walk(const void* p, F& f) {
+    if (isLeaf(p)) {
+        const Leaf* l = asLeaf(p);
+        f(l->key, l->count);
+        return;
+    }
+    const Inner* n = static_cast<const Inner*>(p);
+    if (n->terminal != NULL) {
+        f(n->terminal->key, n->terminal->count);  // a prefix sorts before its extensions
+    }
+    if (n->type == kNode4) {
+        const Node4* n4 = static_cast<const Node4*>(n);
+        for (int i = 0; i < n->children; i++) {
+            walk(n4->child[i], f);
+        }
+    } else if (n->type == kNode16) {
+        const Node16* n16 = static_cast<const Node16*>(n);
+        for (int i = 0; i < n->children; i++) {
+            walk(n16->child[i], f);
+        }
+    } else if (n->type == kNode48) {
+        const Node48* n48 = static_cast<const Node48*>(n);
+        for (int b = 0; b < 256; b++) {
+            if (n48->index[b] != 0) {
+                walk(n48->child[n48->index[b] - 1], f);
+            }
+        }
+    } else {
+        const Node256* n256 = static_cast<const Node256*>(n);
+        for (int b = 0; b < 256; b++) {
+            if (n256->child[b] != NULL) {
+                walk(n256->child[b], f);
+            }
+        }
+    }
+}
+
+#endif
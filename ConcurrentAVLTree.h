@@ -0,0 +1,407 @@
+#ifndef CONCURRENTAVLTREE_H
+#define CONCURRENTAVLTREE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * An AVL tree for many readers and occasional writers. Nodes are never
+ * changed once another thread can see them: a writer copies the path from
+ * the root to the change, rebalances the copies with the usual AVL
+ * rotations, and publishes the new root with one atomic store. Readers load
+ * the root and search without locks or retries, seeing either the tree
+ * before a write or after it.
+ *
+ * Replaced nodes are freed RCU style. A reader counts itself in one of two
+ * counters for the current epoch, sharded so readers on different cores
+ * mostly touch different cache lines. Once enough nodes are retired a
+ * writer flips the epoch twice, waiting each time for the old epoch's
+ * readers to leave, after which no reader can still hold a retired node.
+ *
+ * Writers serialize on a mutex. Values are copied out to readers, since
+ * the node they were read from may be freed after the read.
+ */
+template<class Key, class Value>
+class ConcurrentAVLTree {
+public:
+    ConcurrentAVLTree();
+    ~ConcurrentAVLTree();
+
+    bool find(const Key& key, Value& value) const;  // lock free, copies the value out
+    bool contains(const Key& key) const;
+    void insert(const std::pair<const Key, Value>& item);  // replaces the value of an existing key
+    void remove(const Key& key);
+    size_t size() const;
+    template<typename F>
+    void forEach(F f) const;  // calls f(key, value) in order on one consistent version of the tree
+
+private:
+    struct CNode {
+        Key key;
+        Value value;
+        const CNode* left;
+        const CNode* right;
+        int height;
+    };
+
+    static const size_t kShards = 64;         // reader counters, one cache line each
+    static const size_t kRetireBatch = 4096;  // retired nodes collected before a grace period
+
+    struct alignas(64) ReaderShard {
+        std::atomic<long> active[2];
+    };
+
+    // counts the calling thread as a reader until it goes out of scope
+    class ReadGuard {
+    public:
+        explicit ReadGuard(const ConcurrentAVLTree& tree);
+        ~ReadGuard();
+
+    private:
+        std::atomic<long>* counter;
+    };
+
+    ConcurrentAVLTree(const ConcurrentAVLTree&);
+    ConcurrentAVLTree& operator=(const ConcurrentAVLTree&);
+
+    static int heightOf(const CNode* n);
+    static size_t shardOfThisThread();
+    const CNode* make(const Key& key, const Value& value, const CNode* left, const CNode* right);
+    const CNode* balance(const Key& key, const Value& value, const CNode* left, const CNode* right);
+    const CNode* rotateLeft(const CNode* n);
+    const CNode* rotateRight(const CNode* n);
+    const CNode* insertAt(const CNode* n, const Key& key, const Value& value, bool& added);
+    const CNode* removeAt(const CNode* n, const Key& key);
+    const CNode* removeMin(const CNode* n, const CNode*& min);
+    void retire(const CNode* n);
+    void synchronize();
+    void reclaim();
+    static void destroy(const CNode* n);
+
+    std::atomic<const CNode*> root;
+    std::atomic<size_t> count;
+    std::mutex writer;                  // one writer at a time
+    std::vector<const CNode*> retired;  // replaced nodes readers may still hold, guarded by writer
+    std::atomic<unsigned> epoch;        // parity picks the counter new readers use
+    mutable ReaderShard shards[kShards];
+};
+
+/*
+  ----------------------------------------------------
+  Begin implementations for the ConcurrentAVLTree class.
+  ----------------------------------------------------
+*/
+
+template<class Key, class Value>
+ConcurrentAVLTree<Key, Value>::ConcurrentAVLTree() : root(NULL), count(0), epoch(0) {
+    for (size_t i = 0; i < kShards; i++) {
+        shards[i].active[0] = 0;
+        shards[i].active[1] = 0;
+    }
+}
+
+/**
+ * No reader may still be inside the tree.
+ */
+template<class Key, class Value>
+ConcurrentAVLTree<Key, Value>::~ConcurrentAVLTree() {
+    for (size_t i = 0; i < retired.size(); i++) {
+        delete retired[i];
+    }
+    destroy(root.load());
+}
+
+template<class Key, class Value>
+ConcurrentAVLTree<Key, Value>::ReadGuard::ReadGuard(const ConcurrentAVLTree& tree) {
+    ReaderShard& shard = tree.shards[shardOfThisThread()];
+    counter = &shard.active[tree.epoch.load() & 1];
+    // the increment and the writer's root store and counter loads are all seq_cst, so either
+    // synchronize() waits for this reader or this reader loads the new root
+    counter->fetch_add(1);
+}
+
+template<class Key, class Value>
+ConcurrentAVLTree<Key, Value>::ReadGuard::~ReadGuard() {
+    counter->fetch_sub(1, std::memory_order_release);
+}
+
+template<class Key, class Value>
+bool ConcurrentAVLTree<Key, Value>::find(const Key& key, Value& value) const {
+    ReadGuard guard(*this);
+    const CNode* n = root.load();
+    while (n != NULL) {
+        if (key < n->key) {
+            n = n->left;
+        } else if (n->key < key) {
+            n = n->right;
+        } else {
+            value = n->value;
+            return true;
+        }
+    }
+    return false;
+}
+
+template<class Key, class Value>
+bool ConcurrentAVLTree<Key, Value>::contains(const Key& key) const {
+    Value ignored;
+    return find(key, ignored);
+}
+
+template<class Key, class Value>
+void ConcurrentAVLTree<Key, Value>::insert(const std::pair<const Key, Value>& item) {
+    std::lock_guard<std::mutex> lock(writer);
+    bool added = false;
+    root.store(insertAt(root.load(std::memory_order_relaxed), item.first, item.second, added));
+    if (added) {
+        count.fetch_add(1, std::memory_order_relaxed);
+    }
+    reclaim();
+}
+
+template<class Key, class Value>
+void ConcurrentAVLTree<Key, Value>::remove(const Key& key) {
+    std::lock_guard<std::mutex> lock(writer);
+    const CNode* old = root.load(std::memory_order_relaxed);
+    const CNode* now = removeAt(old, key);
+    if (now != old) {
+        root.store(now);
+        count.fetch_sub(1, std::memory_order_relaxed);
+    }
+    reclaim();
+}
+
+template<class Key, class Value>
+size_t ConcurrentAVLTree<Key, Value>::size() const {
+    return count.load(std::memory_order_relaxed);
+}
+
+/**
+ * Walks the version of the tree current when it starts. Writers carry on
+ * meanwhile, but nothing this walk can reach is freed until it returns.
+ */
+template<class Key, class Value>
+template<typename F>
+void ConcurrentAVLTree<Key, Value>::forEach(F f) const {
+    ReadGuard guard(*this);
+    std::vector<const CNode*> path;
+    const CNode* n = root.load();
+    while (n != NULL || !path.empty()) {
+        while (n != NULL) {
+            path.push_back(n);
+            n = n->left;
+        }
+        n = path.back();
+        path.pop_back();
+        f(n->key, n->value);
+        n = n->right;
+    }
+}
+
+template<class Key, class Value>
+int ConcurrentAVLTree<Key, Value>::heightOf(const CNode* n) {
+    return n == NULL ? 0 : n->height;
+}
+
+template<class Key, class Value>
+size_t ConcurrentAVLTree<Key, Value>::shardOfThisThread() {
+    static thread_local size_t shard = std::hash<std::thread::id>()(std::this_thread::get_id()) % kShards;
+    return shard;
+}
+
+template<class Key, class Value>
+const typename ConcurrentAVLTree<Key, Value>::CNode*
+ConcurrentAVLTree<Key, Value>::make(const Key& key, const Value& value, const CNode* left, const CNode* right) {
+    CNode* n = new CNode{key, value, left, right, std::max(heightOf(left), heightOf(right)) + 1};
+    return n;
+}
+
+/**
+ * Builds a node over left and right, rotating when their heights differ by
+ * two: the four insertFix/removeFix cases, done on fresh copies.
+ */
+template<class Key, class Value>
+const typename ConcurrentAVLTree<Key, Value>::CNode*
+ConcurrentAVLTree<Key, Value>::balance(const Key& key, const Value& value, const CNode* left, const CNode* right) {
+    int diff = heightOf(left) - heightOf(right);
+    if (diff > 1) {
+        if (heightOf(left->left) < heightOf(left->right)) {
+            const CNode* l = left;
+            left = rotateLeft(l);  // zig-zag
+            retire(l);
+        }
+        const CNode* n = make(key, value, left, right);
+        const CNode* top = rotateRight(n);
+        delete n;  // never published
+        return top;
+    } else if (diff < -1) {
+        if (heightOf(right->right) < heightOf(right->left)) {
+            const CNode* r = right;
+            right = rotateRight(r);
+            retire(r);
+        }
+        const CNode* n = make(key, value, left, right);
+        const CNode* top = rotateLeft(n);
+        delete n;
+        return top;
+    }
+    return make(key, value, left, right);
+}
+
+/**
+ * Returns a copy of n rotated left. n and its right child are left as they
+ * were; the caller retires whichever of them was published.
+ */
+template<class Key, class Value>
+const typename ConcurrentAVLTree<Key, Value>::CNode* ConcurrentAVLTree<Key, Value>::rotateLeft(const CNode* n) {
+    const CNode* p = n->right;
+    const CNode* g = make(n->key, n->value, n->left, p->left);
+    const CNode* top = make(p->key, p->value, g, p->right);
+    retire(p);
+    return top;
+}
+
+template<class Key, class Value>
+const typename ConcurrentAVLTree<Key, Value>::CNode* ConcurrentAVLTree<Key, Value>::rotateRight(const CNode* n) {
+    const CNode* p = n->left;
+    const CNode* g = make(n->key, n->value, p->right, n->right);
+    const CNode* top = make(p->key, p->value, p->left, g);
+    retire(p);
+    return top;
+}
+
+template<class Key, class Value>
+const typename ConcurrentAVLTree<Key, Value>::CNode*
+ConcurrentAVLTree<Key, Value>::insertAt(const CNode* n, const Key& key, const Value& value, bool& added) {
+    if (n == NULL) {
+        added = true;
+        return make(key, value, NULL, NULL);
+    }
+    const CNode* copy;
+    if (key < n->key) {
+        copy = balance(n->key, n->value, insertAt(n->left, key, value, added), n->right);
+    } else if (n->key < key) {
+        copy = balance(n->key, n->value, n->left, insertAt(n->right, key, value, added));
+    } else {
+        copy = make(key, value, n->left, n->right);
+    }
+    retire(n);
+    return copy;
+}
+
+/**
+ * Returns n itself when key is not under it, so a miss copies nothing.
+ */
+template<class Key, class Value>
+const typename ConcurrentAVLTree<Key, Value>::CNode*
+ConcurrentAVLTree<Key, Value>::removeAt(const CNode* n, const Key& key) {
+    if (n == NULL) {
+        return NULL;
+    }
+    const CNode* copy;
+    if (key < n->key) {
+        const CNode* left = removeAt(n->left, key);
+        if (left == n->left) {
+            return n;
+        }
+        copy = balance(n->key, n->value, left, n->right);
+    } else if (n->key < key) {
+        const CNode* right = removeAt(n->right, key);
+        if (right == n->right) {
+            return n;
+        }
+        copy = balance(n->key, n->value, n->left, right);
+    } else if (n->left == NULL) {
+        copy = n->right;
+    } else if (n->right == NULL) {
+        copy = n->left;
+    } else {
+        // the successor takes n's place
+        const CNode* min = NULL;
+        const CNode* right = removeMin(n->right, min);
+        copy = balance(min->key, min->value, n->left, right);
+    }
+    retire(n);
+    return copy;
+}
+
+template<class Key, class Value>
+const typename ConcurrentAVLTree<Key, Value>::CNode*
+ConcurrentAVLTree<Key, Value>::removeMin(const CNode* n, const CNode*& min) {
+    if (n->left == NULL) {
+        min = n;  // retired, still readable until the next synchronize()
+        retire(n);
+        return n->right;
+    }
+    const CNode* copy = balance(n->key, n->value, removeMin(n->left, min), n->right);
+    retire(n);
+    return copy;
+}
+
+template<class Key, class Value>
+void ConcurrentAVLTree<Key, Value>::retire(const CNode* n) {
+    retired.push_back(n);
+}
+
+/**
+ * Returns once every reader that could have seen the tree before the
+ * latest root store has left. A reader counts itself under the epoch it
+ * read, which may already be one flip old, so both counters are drained.
+ */
+template<class Key, class Value>
+void ConcurrentAVLTree<Key, Value>::synchronize() {
+    for (int flip = 0; flip < 2; flip++) {
+        unsigned old = epoch.fetch_add(1) & 1;
+        for (size_t i = 0; i < kShards; i++) {
+            while (shards[i].active[old].load() != 0) {
+                std::this_thread::yield();
+            }
+        }
+    }
+}
+
+template<class Key, class Value>
+void ConcurrentAVLTree<Key, Value>::reclaim() {
+    if (retired.size() < kRetireBatch) {
+        return;
+    }
+    synchronize();
+    for (size_t i = 0; i < retired.size(); i++) {
+        delete retired[i];
+    }
+    retired.clear();
+}
+
+template<class Key, class Value>
+void ConcurrentAVLTree<Key, Value>::destroy(const CNode* n) {
+    // post-order without recursion, the same way BinarySearchTree::clear() avoids it
+    std::vector<const CNode*> todo;
+    if (n != NULL) {
+        todo.push_back(n);
+    }
+    while (!todo.empty()) {
+        const CNode* x = todo.back();
+        todo.pop_back();
+        if (x->left != NULL) {
+            todo.push_back(x->left);
+        }
+        if (x->right != NULL) {
+            todo.push_back(x->right);
+        }
+        delete x;
+    }
+}
+
+/*
+  --------------------------------------------------
+  End implementations for the ConcurrentAVLTree class.
+  --------------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,248 @@
+#include "FrontCodedIndex.h"
+
+#include <cstring>
+
+using namespace std;
+
+FrontCodedIndex::FrontCodedIndex() : words_(0) {}
+
+FrontCodedIndex FrontCodedIndex::build(const vector<pair<string, int> >& sorted) {
+    FrontCodedIndex f;
+    f.words_ = sorted.size();
+    const string* prev = NULL;
+    for (size_t i = 0; i < sorted.size(); i++) {
+        const string& w = sorted[i].first;
+        size_t shared = 0;
+        if (i % kBlock == 0) {
+            f.offsets_.push_back((uint32_t)f.data_.size());
+            f.heads_.push_back(prefixOf(w.data(), w.length()));
+        } else {
+            size_t most = min(prev->length(), w.length());
+            while (shared < most && (*prev)[shared] == w[shared]) {
+                shared++;
+            }
+        }
+        putVarint(f.data_, (uint32_t)shared);
+        putVarint(f.data_, (uint32_t)(w.length() - shared));
+        f.data_.insert(f.data_.end(), w.begin() + shared, w.end());
+        putVarint(f.data_, (uint32_t)sorted[i].second);
+        prev = &w;
+    }
+    f.data_.shrink_to_fit();
+    return f;
+}
+
+FrontCodedIndex::iterator FrontCodedIndex::begin() const {
+    return iterator(this, 0);
+}
+
+FrontCodedIndex::iterator FrontCodedIndex::end() const {
+    return iterator(this, words_);
+}
+
+/**
+ * The last block whose first word is not greater than k, or 0. Heads are
+ * compared by their 8 byte prefixes, and only equal prefixes decode the
+ * head itself.
+ */
+size_t FrontCodedIndex::blockFor(const string& k) const {
+    uint64_t p = prefixOf(k.data(), k.length());
+    size_t lo = 0;
+    size_t hi = heads_.size();  // answer in [lo, hi)
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        bool headAfter = heads_[mid] > p;
+        if (heads_[mid] == p) {
+            size_t pos = offsets_[mid];
+            getVarint(&data_[0], pos);  // shared, always 0 for a head
+            size_t len = getVarint(&data_[0], pos);
+            int c = memcmp(&data_[pos], k.data(), min(len, k.length()));
+            headAfter = c > 0 || (c == 0 && len > k.length());
+        }
+        if (headAfter) {
+            hi = mid;
+        } else {
+            lo = mid;
+        }
+    }
+    return lo;
+}
+
+/**
+ * Position of the first word not less than k, and whether it is k (with
+ * its count). Only k's block is scanned, and its words are not decoded:
+ * match is how many bytes the word before shares with k, which it is less
+ * than. An entry sharing more than match bytes with that word is less
+ * than k too, one sharing fewer is greater, and only one sharing exactly
+ * match bytes has its suffix compared, from there on.
+ */
+size_t FrontCodedIndex::seek(const string& k, bool& found, int& count) const {
+    const unsigned char* data = &data_[0];
+    size_t b = blockFor(k);
+    size_t pos = offsets_[b];
+    size_t last = min(words_, (b + 1) * kBlock);
+    size_t match = 0;
+    found = false;
+    for (size_t item = b * kBlock; item < last; item++) {
+        size_t shared = getVarint(data, pos);
+        size_t len = getVarint(data, pos);
+        const unsigned char* suffix = data + pos;
+        pos += len;
+        int c = (int)getVarint(data, pos);
+        if (shared > match) {
+            continue;
+        }
+        if (shared < match) {
+            return item;
+        }
+        size_t rest = k.length() - match;
+        size_t n = min(len, rest);
+        size_t i = 0;
+        while (i < n && suffix[i] == (unsigned char)k[match + i]) {
+            i++;
+        }
+        if (i == n ? len >= rest : suffix[i] > (unsigned char)k[match + i]) {
+            found = len == rest && i == n;
+            count = c;
+            return item;
+        }
+        match += i;
+    }
+    // the next block's head is past k
+    return last;
+}
+
+// the iterator at position item, decoding from the start of its block
+FrontCodedIndex::iterator FrontCodedIndex::at(size_t item) const {
+    iterator it(this, item - item % kBlock);
+    while (it.item_ < item) {
+        ++it;
+    }
+    return it;
+}
+
+FrontCodedIndex::iterator FrontCodedIndex::lower_bound(const string& k) const {
+    if (words_ == 0) {
+        return end();
+    }
+    bool found;
+    int c;
+    return at(seek(k, found, c));
+}
+
+FrontCodedIndex::iterator FrontCodedIndex::find(const string& k) const {
+    if (words_ == 0) {
+        return end();
+    }
+    bool found;
+    int c;
+    size_t item = seek(k, found, c);
+    return found ? at(item) : end();
+}
+
+int FrontCodedIndex::count(const string& k) const {
+    if (words_ == 0) {
+        return 0;
+    }
+    bool found;
+    int c;
+    seek(k, found, c);
+    return found ? c : 0;
+}
+
+size_t FrontCodedIndex::size() const {
+    return words_;
+}
+
+size_t FrontCodedIndex::bytes() const {
+    return data_.size() + offsets_.size() * sizeof(uint32_t) + heads_.size() * sizeof(uint64_t);
+}
+
+uint64_t FrontCodedIndex::prefixOf(const char* s, size_t len) {
+    unsigned char b[8] = {0};
+    memcpy(b, s, len < 8 ? len : 8);
+    uint64_t p = 0;
+    for (int i = 0; i < 8; i++) {
+        p = (p << 8) | b[i];
+    }
+    return p;
+}
+
+// 7 bits a byte, low bits first, high bit set on all but the last byte
+void FrontCodedIndex::putVarint(vector<unsigned char>& out, uint32_t v) {
+    while (v >= 0x80) {
+        out.push_back((unsigned char)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((unsigned char)v);
+}
+
+uint32_t FrontCodedIndex::getVarint(const unsigned char* data, size_t& pos) {
+    uint32_t v = 0;
+    for (int shift = 0;; shift += 7) {
+        unsigned char b = data[pos++];
+        v |= (uint32_t)(b & 0x7F) << shift;
+        if (b < 0x80) {
+            return v;
+        }
+    }
+}
+
+/*
+  ------------------------------------------
+  Begin implementations for the iterator class.
+  ------------------------------------------
+*/
+
+FrontCodedIndex::iterator::iterator() : index_(NULL), item_(0), pos_(0) {}
+
+FrontCodedIndex::iterator::iterator(const FrontCodedIndex* index, size_t item)
+        : index_(index), item_(item), pos_(0) {
+    if (item_ < index_->words_) {
+        pos_ = index_->offsets_[item_ / kBlock];
+        decode();
+    }
+}
+
+/**
+ * Reads the entry at pos_ into current_. Entries that are not block heads
+ * reuse the bytes the previous word left in current_.
+ */
+void FrontCodedIndex::iterator::decode() {
+    const unsigned char* data = &index_->data_[0];
+    size_t shared = getVarint(data, pos_);
+    size_t len = getVarint(data, pos_);
+    current_.first.resize(shared);
+    current_.first.append(reinterpret_cast<const char*>(data + pos_), len);
+    pos_ += len;
+    current_.second = (int)getVarint(data, pos_);
+}
+
+const pair<string, int>& FrontCodedIndex::iterator::operator*() const {
+    return current_;
+}
+
+const pair<string, int>* FrontCodedIndex::iterator::operator->() const {
+    return &current_;
+}
+
+FrontCodedIndex::iterator& FrontCodedIndex::iterator::operator++() {
+    if (++item_ < index_->words_) {
+        decode();  // blocks are back to back, so the next entry is at pos_ either way
+    }
+    return *this;
+}
+
+bool FrontCodedIndex::iterator::operator==(const iterator& o) const {
+    return index_ == o.index_ && item_ == o.item_;
+}
+
+bool FrontCodedIndex::iterator::operator!=(const iterator& o) const {
+    return !(*this == o);
+}
+
+/*
+  ----------------------------------------
+  End implementations for the iterator class.
+  ----------------------------------------
+*/
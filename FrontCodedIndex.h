@@ -0,0 +1,74 @@
+#ifndef FRONTCODEDINDEX_H
+#define FRONTCODEDINDEX_H
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * An immutable ordered word -> count index that stores sorted words front
+ * coded: each word keeps only the bytes after the prefix it shares with the
+ * word before it. Words are grouped in blocks of kBlock; the first word of
+ * a block is stored whole, so a block can be decoded on its own.
+ *
+ * A sampled index holds each block's offset and the first 8 bytes of its
+ * first word as a big-endian integer. A lookup binary searches those dense
+ * integers, then scans at most one block, which is a few dozen contiguous
+ * bytes, without decoding its words: the prefix each shares with the key
+ * follows from the prefix it shares with the word before, so only a few
+ * suffixes are compared. Iteration decodes one word at a time.
+ *
+ * A block entry is varint shared, varint suffix length, suffix bytes and
+ * varint count (the first entry has shared = 0).
+ */
+class FrontCodedIndex {
+public:
+    static const size_t kBlock = 16;  // words per block, trades lookup time for space
+
+    class iterator {
+    public:
+        iterator();
+        const std::pair<std::string, int>& operator*() const;
+        const std::pair<std::string, int>* operator->() const;
+        iterator& operator++();
+        bool operator==(const iterator& o) const;
+        bool operator!=(const iterator& o) const;
+
+    private:
+        friend class FrontCodedIndex;
+        iterator(const FrontCodedIndex* index, size_t item);
+        void decode();
+
+        const FrontCodedIndex* index_;
+        size_t item_;  // position of the current word in sorted order
+        size_t pos_;   // offset of the next entry in data
+        std::pair<std::string, int> current_;
+    };
+
+    FrontCodedIndex();
+    static FrontCodedIndex build(const std::vector<std::pair<std::string, int> >& sorted);  // ascending, distinct
+
+    iterator begin() const;
+    iterator end() const;
+    iterator lower_bound(const std::string& k) const;  // first word not less than k
+    iterator find(const std::string& k) const;
+    int count(const std::string& k) const;
+    size_t size() const;   // number of words
+    size_t bytes() const;  // encoded blocks plus the sampled index
+
+private:
+    static uint64_t prefixOf(const char* s, size_t len);
+    static void putVarint(std::vector<unsigned char>& out, uint32_t v);
+    static uint32_t getVarint(const unsigned char* data, size_t& pos);
+    size_t blockFor(const std::string& k) const;
+    size_t seek(const std::string& k, bool& found, int& count) const;
+    iterator at(size_t item) const;
+
+    std::vector<unsigned char> data_;   // the blocks, back to back
+    std::vector<uint32_t> offsets_;     // where each block starts in data_
+    std::vector<uint64_t> heads_;       // first 8 bytes of each block's first word
+    size_t words_;
+};
+
+#endif
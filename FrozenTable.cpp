@@ -0,0 +1,242 @@
+#include "FrozenTable.h"
+
+#include "Hash.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+const uint32_t kMagic = 0x5A525446;      // "FTRZ"
+const uint32_t kKeysPerBucket = 4;       // average bucket size, trades build time for displacement space
+const uint64_t kTriesPerWord = 64;       // displacements tried per word before changing the seed
+}  // namespace
+
+FrozenTable::FrozenTable()
+        : mapped(NULL),
+          base(NULL),
+          length(0),
+          header(NULL),
+          displacement(NULL),
+          slots(NULL),
+          keys(NULL) {}
+
+FrozenTable::FrozenTable(FrozenTable&& other) : FrozenTable() {
+    *this = std::move(other);
+}
+
+FrozenTable& FrozenTable::operator=(FrozenTable&& other) {
+    if (this != &other) {
+        release();
+        owned.swap(other.owned);
+        mapped = other.mapped;
+        other.mapped = NULL;
+        if (other.base != NULL) {
+            attach(other.base, other.length);
+        }
+        other.release();
+    }
+    return *this;
+}
+
+FrozenTable::~FrozenTable() {
+    release();
+}
+
+void FrozenTable::release() {
+    if (mapped != NULL) {
+        munmap(mapped, length);
+    }
+    owned.clear();
+    mapped = NULL;
+    base = NULL;
+    length = 0;
+    header = NULL;
+    displacement = NULL;
+    slots = NULL;
+    keys = NULL;
+}
+
+void FrozenTable::attach(const char* b, size_t len) {
+    base = b;
+    length = len;
+    header = reinterpret_cast<const Header*>(base);
+    displacement = reinterpret_cast<const uint32_t*>(base + sizeof(Header));
+    slots = reinterpret_cast<const Entry*>(displacement + header->buckets);
+    keys = reinterpret_cast<const char*>(slots + header->words);
+}
+
+void FrozenTable::slotHashes(const string& k, uint32_t seed, uint32_t buckets, uint32_t words, uint32_t& bucket,
+                             uint32_t& h1, uint32_t& h2) {
+    uint64_t x = mix64(hashBytes(k.data(), k.length()) ^ (seed * 0x9E3779B97F4A7C15ULL));
+    uint64_t y = mix64(x + 0x9E3779B97F4A7C15ULL);
+    bucket = (uint32_t)(((x >> 32) * buckets) >> 32);
+    h1 = (uint32_t)(x % words);
+    h2 = (uint32_t)(y % words);
+}
+
+/**
+ * Buckets are placed largest first. A bucket's displacement i is the first
+ * that sends every key in it to a distinct free slot, with key slots
+ * (h1 + d0 * h2 + d1) % words for d0 = i % words and d1 = i / words. If a
+ * bucket cannot be placed the build starts over with another seed.
+ */
+FrozenTable FrozenTable::build(const vector<pair<string, int> >& items) {
+    uint32_t n = (uint32_t)items.size();
+    uint32_t buckets = max((uint32_t)1, n / kKeysPerBucket);
+    vector<uint32_t> disp(buckets, 0);
+    vector<uint32_t> slotOf(n, 0);
+
+    for (uint32_t seed = 1; n > 0; seed++) {
+        vector<uint32_t> bucketOf(n), h1(n), h2(n);
+        vector<vector<uint32_t> > members(buckets);
+        for (uint32_t i = 0; i < n; i++) {
+            slotHashes(items[i].first, seed, buckets, n, bucketOf[i], h1[i], h2[i]);
+            members[bucketOf[i]].push_back(i);
+        }
+        vector<uint32_t> order(buckets);
+        for (uint32_t b = 0; b < buckets; b++) {
+            order[b] = b;
+        }
+        stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+            return members[a].size() > members[b].size();
+        });
+
+        // the last buckets need about n tries to find one of the few free slots, a
+        // bucket that needs far more usually has two keys that always collide
+        uint64_t maxTries = min((uint64_t)~0U, kTriesPerWord * n);
+        vector<bool> taken(n, false);
+        vector<uint32_t> trial;
+        bool placedAll = true;
+        for (uint32_t o = 0; o < buckets && placedAll; o++) {
+            const vector<uint32_t>& keysIn = members[order[o]];
+            if (keysIn.empty()) {
+                break;  // sorted by size, the rest are empty too
+            }
+            bool placed = false;
+            for (uint64_t i = 0; i < maxTries && !placed; i++) {
+                uint64_t d0 = i % n;
+                uint64_t d1 = i / n;
+                trial.clear();
+                for (size_t j = 0; j < keysIn.size(); j++) {
+                    uint32_t slot = (uint32_t)((h1[keysIn[j]] + d0 * h2[keysIn[j]] + d1) % n);
+                    if (taken[slot] || find(trial.begin(), trial.end(), slot) != trial.end()) {
+                        break;
+                    }
+                    trial.push_back(slot);
+                }
+                if (trial.size() == keysIn.size()) {
+                    for (size_t j = 0; j < keysIn.size(); j++) {
+                        taken[trial[j]] = true;
+                        slotOf[keysIn[j]] = trial[j];
+                    }
+                    disp[order[o]] = (uint32_t)i;
+                    placed = true;
+                }
+            }
+            placedAll = placed;
+        }
+        if (placedAll) {
+            // lay out the flat buffer
+            uint64_t keyBytes = 0;
+            for (uint32_t i = 0; i < n; i++) {
+                keyBytes += items[i].first.length();
+            }
+            FrozenTable t;
+            t.owned.resize(sizeof(Header) + buckets * sizeof(uint32_t) + n * sizeof(Entry) + keyBytes);
+            Header h = {kMagic, n, buckets, seed, keyBytes};
+            memcpy(&t.owned[0], &h, sizeof(h));
+            memcpy(&t.owned[sizeof(Header)], &disp[0], buckets * sizeof(uint32_t));
+            t.attach(&t.owned[0], t.owned.size());
+
+            Entry* slots = const_cast<Entry*>(t.slots);
+            char* keys = const_cast<char*>(t.keys);
+            uint32_t offset = 0;
+            for (uint32_t i = 0; i < n; i++) {
+                Entry e = {offset, (uint32_t)items[i].first.length(), items[i].second};
+                slots[slotOf[i]] = e;
+                memcpy(keys + offset, items[i].first.data(), e.length);
+                offset += e.length;
+            }
+            return t;
+        }
+    }
+
+    // no words: a header and one empty bucket
+    FrozenTable t;
+    t.owned.resize(sizeof(Header) + sizeof(uint32_t), 0);
+    Header h = {kMagic, 0, 1, 0, 0};
+    memcpy(&t.owned[0], &h, sizeof(h));
+    t.attach(&t.owned[0], t.owned.size());
+    return t;
+}
+
+bool FrozenTable::save(const string& path) const {
+    FILE* f = fopen(path.c_str(), "wb");
+    if (f == NULL) {
+        return false;
+    }
+    bool ok = fwrite(base, 1, length, f) == length;
+    return fclose(f) == 0 && ok;
+}
+
+bool FrozenTable::open(const string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Header)) {
+        close(fd);
+        return false;
+    }
+    void* m = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED) {
+        return false;
+    }
+
+    // check the header agrees with the file before trusting any offset in it
+    const Header* h = static_cast<const Header*>(m);
+    uint64_t expected = sizeof(Header) + (uint64_t)h->buckets * sizeof(uint32_t) + (uint64_t)h->words * sizeof(Entry)
+                        + h->keyBytes;
+    if (h->magic != kMagic || h->buckets == 0 || expected != (uint64_t)st.st_size) {
+        munmap(m, st.st_size);
+        return false;
+    }
+
+    release();
+    mapped = m;
+    attach(static_cast<const char*>(m), st.st_size);
+    return true;
+}
+
+int FrozenTable::count(const string& k) const {
+    if (header == NULL || header->words == 0) {
+        return 0;
+    }
+    uint32_t n = header->words;
+    uint32_t bucket, h1, h2;
+    slotHashes(k, header->seed, header->buckets, n, bucket, h1, h2);
+    uint64_t i = displacement[bucket];
+    const Entry& e = slots[(h1 + (i % n) * h2 + i / n) % n];
+
+    // the one probe: a word not in the table still lands on some slot
+    if (e.length == k.length() && memcmp(keys + e.offset, k.data(), e.length) == 0) {
+        return e.count;
+    }
+    return 0;
+}
+
+size_t FrozenTable::size() const {
+    return header == NULL ? 0 : header->words;
+}
+
+size_t FrozenTable::bytes() const {
+    return length;
+}
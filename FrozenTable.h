@@ -0,0 +1,69 @@
+#ifndef FROZENTABLE_H
+#define FROZENTABLE_H
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * An immutable word -> count dictionary built with a minimal perfect hash
+ * (CHD: hash, displace and compress). Every word maps to its own slot with
+ * one bucket displacement lookup, and count() compares against exactly one
+ * slot. There are as many slots as words, with no empty ones.
+ *
+ * The whole table is one flat buffer of fixed-width fields with no
+ * pointers, so save() can write it out and open() can mmap it back without
+ * parsing:
+ *
+ *   Header | uint32 displacement[buckets] | Entry slot[words] | key bytes
+ */
+class FrozenTable {
+public:
+    FrozenTable();
+    FrozenTable(FrozenTable&& other);
+    FrozenTable& operator=(FrozenTable&& other);
+    ~FrozenTable();
+
+    static FrozenTable build(const std::vector<std::pair<std::string, int> >& items);
+    bool save(const std::string& path) const;
+    bool open(const std::string& path);  // maps a saved table read-only
+
+    int count(const std::string& k) const;
+    size_t size() const;   // number of words
+    size_t bytes() const;  // size of the flat buffer
+
+private:
+    struct Header {
+        uint32_t magic;
+        uint32_t words;
+        uint32_t buckets;
+        uint32_t seed;
+        uint64_t keyBytes;
+    };
+    struct Entry {
+        uint32_t offset;  // into the key bytes
+        uint32_t length;
+        int32_t count;
+    };
+
+    FrozenTable(const FrozenTable&);
+    FrozenTable& operator=(const FrozenTable&);
+    void release();
+    void attach(const char* base, size_t length);
+    static void slotHashes(const std::string& k, uint32_t seed, uint32_t buckets, uint32_t words,
+                           uint32_t& bucket, uint32_t& h1, uint32_t& h2);
+
+    std::vector<char> owned;  // the buffer when built in memory
+    void* mapped;             // the mapping when opened from a file
+    const char* base;
+    size_t length;
+
+    // views into the buffer
+    const Header* header;
+    const uint32_t* displacement;
+    const Entry* slots;
+    const char* keys;
+};
+
+#endif
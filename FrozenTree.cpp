@@ -0,0 +1,211 @@
+#include "FrozenTree.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+const uint32_t kMagic = 0x45525446;  // "FTRE"
+
+// fills positions k and below of an Eytzinger array in order, taking sorted items from next
+void fillEytzinger(vector<uint32_t>& order, size_t k, uint32_t& next) {
+    if (k >= order.size()) {
+        return;
+    }
+    fillEytzinger(order, 2 * k, next);
+    order[k] = next++;
+    fillEytzinger(order, 2 * k + 1, next);
+}
+}  // namespace
+
+FrozenTree::FrozenTree()
+        : mapped(NULL), base(NULL), length(0), header(NULL), prefix(NULL), entries(NULL), keys(NULL) {}
+
+FrozenTree::FrozenTree(FrozenTree&& other) : FrozenTree() {
+    *this = std::move(other);
+}
+
+FrozenTree& FrozenTree::operator=(FrozenTree&& other) {
+    if (this != &other) {
+        release();
+        owned.swap(other.owned);
+        mapped = other.mapped;
+        other.mapped = NULL;
+        if (other.base != NULL) {
+            attach(other.base, other.length);
+        }
+        other.release();
+    }
+    return *this;
+}
+
+FrozenTree::~FrozenTree() {
+    release();
+}
+
+void FrozenTree::release() {
+    if (mapped != NULL) {
+        munmap(mapped, length);
+    }
+    owned.clear();
+    mapped = NULL;
+    base = NULL;
+    length = 0;
+    header = NULL;
+    prefix = NULL;
+    entries = NULL;
+    keys = NULL;
+}
+
+void FrozenTree::attach(const char* b, size_t len) {
+    base = b;
+    length = len;
+    header = reinterpret_cast<const Header*>(base);
+    prefix = reinterpret_cast<const uint64_t*>(base + sizeof(Header));
+    entries = reinterpret_cast<const Entry*>(prefix + header->words + 1);
+    keys = reinterpret_cast<const char*>(entries + header->words + 1);
+}
+
+/**
+ * The first 8 bytes of s, zero padded, as a big-endian integer, so prefixes
+ * compare like the strings they start. Equal prefixes say nothing about
+ * the order of the whole strings.
+ */
+uint64_t FrozenTree::prefixOf(const char* s, size_t len) {
+    unsigned char b[8] = {0};
+    memcpy(b, s, len < 8 ? len : 8);
+    uint64_t p = 0;
+    for (int i = 0; i < 8; i++) {
+        p = (p << 8) | b[i];
+    }
+    return p;
+}
+
+FrozenTree FrozenTree::build(const vector<pair<string, int> >& sorted) {
+    uint32_t n = (uint32_t)sorted.size();
+    vector<uint32_t> order(n + 1, 0);  // sorted index held at each position
+    uint32_t next = 0;
+    fillEytzinger(order, 1, next);
+
+    uint64_t keyBytes = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        keyBytes += sorted[i].first.length();
+    }
+    FrozenTree t;
+    t.owned.resize(sizeof(Header) + (n + 1) * (sizeof(uint64_t) + sizeof(Entry)) + keyBytes, 0);
+    Header h = {kMagic, n, keyBytes};
+    memcpy(&t.owned[0], &h, sizeof(h));
+    t.attach(&t.owned[0], t.owned.size());
+
+    // keys stay in sorted order, so neighbouring words share cache lines
+    vector<uint32_t> offsets(n, 0);
+    char* keys = const_cast<char*>(t.keys);
+    uint32_t offset = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        offsets[i] = offset;
+        memcpy(keys + offset, sorted[i].first.data(), sorted[i].first.length());
+        offset += (uint32_t)sorted[i].first.length();
+    }
+    uint64_t* prefix = const_cast<uint64_t*>(t.prefix);
+    Entry* entries = const_cast<Entry*>(t.entries);
+    for (uint32_t k = 1; k <= n; k++) {
+        const string& w = sorted[order[k]].first;
+        prefix[k] = prefixOf(w.data(), w.length());
+        Entry e = {offsets[order[k]], (uint32_t)w.length(), sorted[order[k]].second};
+        entries[k] = e;
+    }
+    return t;
+}
+
+bool FrozenTree::save(const string& path) const {
+    FILE* f = fopen(path.c_str(), "wb");
+    if (f == NULL) {
+        return false;
+    }
+    bool ok = fwrite(base, 1, length, f) == length;
+    return fclose(f) == 0 && ok;
+}
+
+bool FrozenTree::open(const string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Header)) {
+        close(fd);
+        return false;
+    }
+    void* m = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED) {
+        return false;
+    }
+
+    // check the header agrees with the file before trusting any offset in it
+    const Header* h = static_cast<const Header*>(m);
+    uint64_t expected = sizeof(Header) + ((uint64_t)h->words + 1) * (sizeof(uint64_t) + sizeof(Entry)) + h->keyBytes;
+    if (h->magic != kMagic || expected != (uint64_t)st.st_size) {
+        munmap(m, st.st_size);
+        return false;
+    }
+
+    release();
+    mapped = m;
+    attach(static_cast<const char*>(m), st.st_size);
+    return true;
+}
+
+/**
+ * Returns the position of the first word not less than k, or 0 if there is
+ * none. Going right appends a 1 bit to the position and going left a 0, so
+ * once the walk falls off the bottom, the last left turn is undone by
+ * shifting off the trailing 1s and the 0 before them.
+ */
+size_t FrozenTree::lowerBound(const string& k) const {
+    size_t n = header->words;
+    uint64_t p = prefixOf(k.data(), k.length());
+    size_t i = 1;
+    while (i <= n) {
+        __builtin_prefetch(prefix + 16 * i);  // 4 levels down, two cache lines of prefixes
+        uint64_t q = prefix[i];
+        bool less = q < p;
+        if (q == p) {
+            // only words sharing the first 8 bytes need their full bytes compared
+            const Entry& e = entries[i];
+            size_t common = e.length < k.length() ? e.length : k.length();
+            int c = memcmp(keys + e.offset, k.data(), common);
+            less = c < 0 || (c == 0 && e.length < k.length());
+        }
+        i = 2 * i + less;
+    }
+    return i >> __builtin_ffsll(~i);
+}
+
+int FrozenTree::count(const string& k) const {
+    if (header == NULL || header->words == 0) {
+        return 0;
+    }
+    size_t i = lowerBound(k);
+    if (i == 0) {
+        return 0;
+    }
+    const Entry& e = entries[i];
+    if (e.length == k.length() && memcmp(keys + e.offset, k.data(), e.length) == 0) {
+        return e.count;
+    }
+    return 0;
+}
+
+size_t FrozenTree::size() const {
+    return header == NULL ? 0 : header->words;
+}
+
+size_t FrozenTree::bytes() const {
+    return length;
+}
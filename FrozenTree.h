@@ -0,0 +1,94 @@
+#ifndef FROZENTREE_H
+#define FROZENTREE_H
+
+#include "avlbst.h"
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * An immutable ordered word -> count dictionary for lookups after counting.
+ * The sorted words are stored in Eytzinger (breadth-first) order: the
+ * children of position k are at 2k and 2k + 1, so a search walks down an
+ * implicit complete tree with no pointers, and the next levels it can
+ * visit sit together in memory and are prefetched ahead of it.
+ *
+ * Each position also keeps the first 8 bytes of its word as a big-endian
+ * integer, and the descent compares those; only words that share all 8 go
+ * on to compare their full bytes. Apart from that rare case, the step taken
+ * at each level is computed, not branched on.
+ *
+ * Like FrozenTable it is one flat buffer with no pointers, so save() and
+ * open() write it out and mmap it back as is:
+ *
+ *   Header | uint64 prefix[words + 1] | Entry entry[words + 1] | key bytes
+ *
+ * Position 0 of both arrays is unused.
+ */
+class FrozenTree {
+public:
+    FrozenTree();
+    FrozenTree(FrozenTree&& other);
+    FrozenTree& operator=(FrozenTree&& other);
+    ~FrozenTree();
+
+    static FrozenTree build(const std::vector<std::pair<std::string, int> >& sorted);  // ascending, distinct words
+    bool save(const std::string& path) const;
+    bool open(const std::string& path);  // maps a saved tree read-only
+
+    int count(const std::string& k) const;
+    size_t size() const;   // number of words
+    size_t bytes() const;  // size of the flat buffer
+
+private:
+    struct Header {
+        uint32_t magic;
+        uint32_t words;
+        uint64_t keyBytes;
+    };
+    struct Entry {
+        uint32_t offset;  // into the key bytes
+        uint32_t length;
+        int32_t count;
+    };
+
+    FrozenTree(const FrozenTree&);
+    FrozenTree& operator=(const FrozenTree&);
+    void release();
+    void attach(const char* base, size_t length);
+    static uint64_t prefixOf(const char* s, size_t len);
+    size_t lowerBound(const std::string& k) const;
+
+    std::vector<char> owned;  // the buffer when built in memory
+    void* mapped;             // the mapping when opened from a file
+    const char* base;
+    size_t length;
+
+    // views into the buffer
+    const Header* header;
+    const uint64_t* prefix;
+    const Entry* entries;
+    const char* keys;
+};
+
+// lets freeze() take the bytes of std::string keys
+inline const std::string& keyString(const std::string& k) {
+    return k;
+}
+
+/**
+ * Exports the items of an AVL tree of counts, in order, to a FrozenTree.
+ * The key type needs a keyString() overload giving its bytes.
+ */
+template<class Key>
+FrozenTree freeze(const AVLTree<Key, int>& tree) {
+    std::vector<std::pair<std::string, int> > sorted;
+    for (typename AVLTree<Key, int>::iterator it = tree.begin(); it != tree.end(); ++it) {
+        sorted.push_back(std::make_pair(std::string(keyString(it->first)), it->second));
+    }
+    return FrozenTree::build(sorted);
+}
+
+#endif
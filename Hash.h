@@ -0,0 +1,31 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * The murmur3 64-bit finalizer: every output bit depends on every input bit.
+ */
+inline uint64_t mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+/**
+ * FNV-1a over the bytes followed by mix64. Used wherever a structure needs
+ * its own hash of a word independent of Hashtable's seeded one.
+ */
+inline uint64_t hashBytes(const char* s, size_t len) {
+    uint64_t x = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        x = (x ^ (unsigned char)s[i]) * 1099511628211ULL;
+    }
+    return mix64(x);
+}
+
+#endif
@@ -1,105 +1,587 @@
 #include "Hashtable.h"
 
+#include "Hash.h"
+#include "LargePages.h"
+#include <algorithm>
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <new>
 #include <ostream>
 #include <random>
+#include <stdexcept>
+#include <type_traits>
+#include <thread>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 using namespace std;
 
-Hashtable::Hashtable(bool debug, unsigned int probing) : d(debug), probeType(probing) {
+namespace {
+const signed char kEmpty = -128;   // control byte of a slot that was never used
+const signed char kDeleted = -2;   // control byte of a removed slot
+const int kGroup = 16;             // control bytes scanned per probe step
+const size_t kCacheLine = 64;      // slot and fingerprint arrays start on a line
+const int kBucket = 4;             // slots per cuckoo bucket
+const int kStash = 4;              // cuckoo slots past the last bucket, for keys neither bucket can take
+const size_t kMaxEvictions = 500;  // cuckoo slots searched for an eviction path before the stash is used
+
+// bitmask of which of the kGroup control bytes starting at g equal c
+unsigned int matchGroup(const signed char* g, signed char c) {
+#ifdef __SSE2__
+    __m128i group = _mm_loadu_si128(reinterpret_cast<const __m128i*>(g));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(c)));
+#else
+    unsigned int mask = 0;
+    for (int i = 0; i < kGroup; i++) {
+        if (g[i] == c) {
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+#endif
+}
+
+// low 7 bits of the hash, the slot index comes from the high 32
+signed char tagOf(unsigned long long hash) {
+    return (signed char)(hash & 0x7F);
+}
+
+// cuckoo fingerprint of a key, never 0 so 0 can mark an empty slot
+uint32_t printOf(unsigned long long hash) {
+    uint32_t p = (uint32_t)(hash ^ (hash >> 32));
+    return p != 0 ? p : 1;
+}
+
+// count zeroed fingerprints, starting on a cache line
+uint32_t* allocPrints(int count) {
+    void* p = NULL;
+    size_t bytes = count * sizeof(uint32_t);
+    if (posix_memalign(&p, kCacheLine, bytes) != 0) {
+        throw bad_alloc();
+    }
+    memset(p, 0, bytes);
+    return static_cast<uint32_t*>(p);
+}
+}  // namespace
+
+Hashtable::Hashtable(bool debug, unsigned int probing, StringArena* arena, bool hugePages)
+        : d(debug), probeType(probing), huge(hugePages), keys(arena != nullptr ? arena : &ownKeys) {
     size = sizes[arrayIt];
-    h = new pair<string, int>*[size]();
+    h = allocSlots(size);
+    if (probeType == 4) {
+        dist = new int[size]();
+    } else if (probeType == 5) {
+        ctrl = new signed char[size + kGroup - 1];
+        fill(ctrl, ctrl + size + kGroup - 1, kEmpty);
+    } else if (probeType == 8) {
+        prints = allocPrints(size);
+    }
     if (!d) 
     {
+        // seeded once for the table's lifetime so cached hashes survive resizes
         srand(time(NULL));
         for (int i = 0; i < 5; i++) {
-            r[i] = rand() % size;
+            r[i] = rand();
         }
     }
 }
 
 Hashtable::~Hashtable() {
-    // loop thru old hashtable, add to new hashtable
-    for (int i = 0; i < size; i++) {
-        if (h[i] != nullptr) {
-            delete h[i];  // deallocate old hashtable
-        }
-    }
-    delete[] h;
+    // slots hold their keys inline, long key bytes are freed with the arena
+    freeSlots(h, size);
+    delete[] dist;
+    delete[] ctrl;
+    free(prints);
 }
 
 void Hashtable::add(string k) {
-    if ((double)(n) / size >= 0.5) {
-        resize();
-    }
+    makeRoom(0);
+    SmallKey key = SmallKey::view(k);
+    addHashed(key, fullHash(key));
+}
 
-    // get new hash
-    int hK = hash(k);
-    int hK2 = doubleHash(k);
-    int i = 0;
-    int index = getIndex(hK, k, i, hK2, hK);
+void Hashtable::addHashed(const SmallKey& key, unsigned long long hK, int c) {
+    int index = find(key, hK);
 
     // is K already in hashtable?
     if (index >= 0) {
-        h[index]->second++;
+        h[index].count += c;
     } else  // not in hashtable
     {
-        if (resized) {
-            h[hK] = new pair<string, int>(k, oldNum);
+        Slot s;
+        s.key = SmallKey(key.data(), key.size(), *keys);  // the only time the key's bytes are copied
+        s.hash = hK;
+        s.count = c;
+        place(s);
+        n += 1;
+    }
+}
+
+void Hashtable::makeRoom(int more) {
+    // keeps the load under 0.5 once more new words are in
+    while ((double)(n + tombs + more) / size >= 0.5) {
+        if (tombs > n) {
+            growTo(arrayIt);  // mostly deleted slots: rebuilding at this size sweeps them away
         } else {
-            h[hK] = new pair<string, int>(k, 1);
+            resize();
         }
-        n += 1;
     }
 }
 
-int Hashtable::count(string k) {
-    int hK = hash(k);
-    int hK2 = doubleHash(k);
-    int i = 0;
-    int index = getIndex(hK, k, i, hK2, hK);  // find k
+void Hashtable::addBatch(const string* ks, size_t num) {
+    SmallKey key[kBatchWindow];
+    unsigned long long hK[kBatchWindow];
+
+    for (size_t start = 0; start < num; start += kBatchWindow) {
+        size_t w = min(num - start, (size_t)kBatchWindow);
+        // grow up front so no slot we prefetch moves before we get to it
+        makeRoom(w);
+        for (size_t j = 0; j < w; j++) {
+            key[j] = SmallKey::view(ks[start + j]);
+            hK[j] = fullHash(key[j]);
+            prefetch(hK[j]);
+        }
+        for (size_t j = 0; j < w; j++) {
+            addHashed(key[j], hK[j]);
+        }
+    }
+}
+
+int Hashtable::count(string k) const {
+    SmallKey key = SmallKey::view(k);
+    int index = find(key, fullHash(key));
     if (index >= 0)
-        return h[index]->second;
+        return h[index].count;
     else
         return 0;
 }
 
-int Hashtable::getIndex(int& hK, const string& k, int& i, int& hK2, const int temp) const {
-    if (h[hK] == nullptr)
+void Hashtable::countBatch(const string* ks, size_t num, int* out) const {
+    SmallKey key[kBatchWindow];
+    unsigned long long hK[kBatchWindow];
+
+    for (size_t start = 0; start < num; start += kBatchWindow) {
+        size_t w = min(num - start, (size_t)kBatchWindow);
+        // hash the whole window and start every load before waiting on any of them
+        for (size_t j = 0; j < w; j++) {
+            key[j] = SmallKey::view(ks[start + j]);
+            hK[j] = fullHash(key[j]);
+            prefetch(hK[j]);
+        }
+        for (size_t j = 0; j < w; j++) {
+            int index = find(key[j], hK[j]);
+            out[start + j] = index >= 0 ? h[index].count : 0;
+        }
+    }
+}
+
+void Hashtable::prefetch(unsigned long long hash) const {
+    int index = home(hash);
+    if (probeType == 5) {
+        __builtin_prefetch(ctrl + index);
+    } else if (probeType == 8) {
+        int b1, b2;
+        cuckooBuckets(hash, b1, b2);
+        // all a miss reads, a hit reads its slot's line after them
+        __builtin_prefetch(prints + b1 * kBucket);
+        __builtin_prefetch(prints + b2 * kBucket);
+        return;
+    }
+    __builtin_prefetch(h + index);
+}
+
+void Hashtable::remove(string k) {
+    SmallKey key = SmallKey::view(k);
+    int index = find(key, fullHash(key));
+    if (index < 0) {
+        return;
+    }
+    n -= 1;
+
+    if (probeType == 4) {
+        // backward shift: pull every displaced entry after index one slot closer to home
+        int next = (index + 1) % size;
+        while (h[next].count != 0 && dist[next] > 0) {
+            h[index] = h[next];
+            dist[index] = dist[next] - 1;
+            index = next;
+            next = (next + 1) % size;
+        }
+        h[index] = Slot();
+        dist[index] = 0;
+    } else if (probeType == 5) {
+        h[index] = Slot();
+        setCtrl(index, kDeleted);  // later keys may have probed past this slot
+        tombs += 1;
+    } else if (probeType == 8) {
+        // lookups only look in fixed places, so nothing else moves
+        if (index >= (size - kStash) / kBucket * kBucket) {
+            stashed -= 1;
+        }
+        h[index] = Slot();
+        prints[index] = 0;
+    } else {
+        // later keys may have probed past this slot, so it stays on their path
+        h[index] = Slot();
+        h[index].deleted = true;
+        tombs += 1;
+    }
+}
+
+void Hashtable::merge(const Hashtable& other) {
+    if (&other == this) {
+        for (int i = 0; i < size; i++) {
+            h[i].count *= 2;
+        }
+        return;
+    }
+    reserve(n + other.n);  // at most n + other.n words, usually one jump instead of the resize ladder
+
+    // tables that hash alike can use the cached hashes as they are
+    bool sameSeeds = hashesLike(other);
+    for (int i = 0; i < other.size; i++) {
+        const Slot& s = other.h[i];
+        if (s.count != 0) {
+            makeRoom(0);
+            addHashed(s.key, sameSeeds ? s.hash : fullHash(s.key), s.count);
+        }
+    }
+}
+
+/**
+ * Merges every table in others into this one on threads threads (0 means
+ * one per core). Thread t owns the words whose hash falls in the t-th share
+ * of the low 32 bits; it reads every source and sums its own words in a
+ * private table seeded like this one. The shares are disjoint, so this table
+ * is then rebuilt once at its final size, placing each word with no lookup
+ * and no rehash.
+ */
+void Hashtable::mergeAll(const vector<const Hashtable*>& others, unsigned int threads) {
+    if (threads == 0) {
+        threads = max(1u, thread::hardware_concurrency());
+    }
+    vector<const Hashtable*> sources(1, this);
+    long long total = n;
+    for (size_t j = 0; j < others.size(); j++) {
+        if (others[j] == this) {
+            continue;  // reading this while rebuilding it would lose counts, use merge(*this)
+        }
+        sources.push_back(others[j]);
+        total += others[j]->n;
+    }
+
+    vector<unique_ptr<Hashtable> > parts(threads);
+    vector<thread> workers;
+    for (unsigned int t = 0; t < threads; t++) {
+        workers.push_back(thread([&, t]() {
+            // made and sized on the thread that fills it, so its slots are first touched there; built as
+            // debug so it skips rand(), which is not thread safe, and takes this table's seeds instead
+            parts[t].reset(new Hashtable(true, probeType, nullptr, huge));
+            Hashtable& part = *parts[t];
+            part.d = d;
+            copy(r, r + 5, part.r);
+            part.reserve((int)min(total / threads + 1, (long long)sizes[27] / 2));
+            for (size_t j = 0; j < sources.size(); j++) {
+                const Hashtable& src = *sources[j];
+                bool sameSeeds = hashesLike(src);
+                for (int i = 0; i < src.size; i++) {
+                    const Slot& s = src.h[i];
+                    if (s.count == 0) {
+                        continue;
+                    }
+                    unsigned long long hK = sameSeeds ? s.hash : fullHash(s.key);
+                    if ((((hK & 0xFFFFFFFFULL) * threads) >> 32) == t) {
+                        part.makeRoom(0);
+                        part.addHashed(s.key, hK, s.count);
+                    }
+                }
+            }
+        }));
+    }
+    for (unsigned int t = 0; t < threads; t++) {
+        workers[t].join();
+    }
+
+    // start over at the size for the merged words, then place them
+    int merged = 0;
+    for (unsigned int t = 0; t < threads; t++) {
+        merged += parts[t]->n;
+    }
+    int it = 0;
+    while (it < 27 && (double)merged / sizes[it] >= 0.5) {
+        it++;
+    }
+    // every thread may read the merged table, so its pages are spread over the NUMA nodes
+    Slot* buf = h;
+    int oldSize = size;
+    arrayIt = it;
+    size = sizes[arrayIt];
+    h = allocSlots(size, true);
+    rebuild(nullptr, 0);
+    freeSlots(buf, oldSize);
+    n = 0;
+    for (unsigned int t = 0; t < threads; t++) {
+        const Hashtable& part = *parts[t];
+        for (int i = 0; i < part.size; i++) {
+            if (part.h[i].count != 0) {
+                Slot s = part.h[i];
+                s.key = SmallKey(s.key.data(), s.key.size(), *keys);  // out of the part's own arena
+                place(s);
+                n += 1;
+            }
+        }
+    }
+}
+
+int Hashtable::find(const SmallKey& key, unsigned long long hash) const {
+    if (probeType == 4) {
+        return robinFind(key, home(hash));
+    } else if (probeType == 5) {
+        return swissFind(key, home(hash), tagOf(hash));
+    } else if (probeType == 8) {
+        return cuckooFind(key, hash);
+    }
+
+    int hK = home(hash);
+    int hK2 = doubleHash(hash);
+    int i = 0;
+    return getIndex(hK, key, i, hK2, hK);
+}
+
+void Hashtable::place(const Slot& s) {
+    if (probeType == 4) {
+        robinInsert(s, home(s.hash));
+    } else if (probeType == 5) {
+        swissInsert(s, home(s.hash), tagOf(s.hash));
+    } else if (probeType == 8) {
+        while (!cuckooInsert(s)) {
+            growTo(arrayIt + 1);  // no eviction path and a full stash, very unlikely at half load
+        }
+    } else {
+        // s's key is not in the table, so the first free slot on its probe sequence takes it
+        int temp = home(s.hash);
+        int hK2 = doubleHash(s.hash);
+        int hK = temp;
+        for (int i = 1; h[hK].count != 0; i++) {
+            hK = probeAt(temp, i, hK2);
+        }
+        if (h[hK].deleted) {
+            tombs -= 1;
+        }
+        h[hK] = s;
+    }
+}
+
+int Hashtable::robinFind(const SmallKey& k, int hK) const {
+    for (int i = 0;; i++) {
+        int index = (hK + i) % size;
+        // an entry closer to its home than we are to ours means k would have displaced it
+        if (h[index].count == 0 || dist[index] < i) {
+            return -1;
+        }
+        if (dist[index] == i && h[index].key == k) {
+            return index;
+        }
+    }
+}
+
+void Hashtable::robinInsert(Slot e, int hK) {
+    int i = 0;
+    int index = hK;
+    while (h[index].count != 0) {
+        // take from the rich: the new entry claims slots whose owner is closer to home
+        if (dist[index] < i) {
+            swap(e, h[index]);
+            swap(i, dist[index]);
+        }
+        index = (index + 1) % size;
+        i++;
+    }
+    h[index] = e;
+    dist[index] = i;
+}
+
+int Hashtable::swissFind(const SmallKey& k, int hK, signed char tag) const {
+    for (int pos = hK;; pos = (pos + kGroup) % size) {
+        // full key compares only on slots whose tag matches
+        for (unsigned int m = matchGroup(ctrl + pos, tag); m != 0; m &= m - 1) {
+            int index = (pos + __builtin_ctz(m)) % size;
+            if (h[index].key == k) {
+                return index;
+            }
+        }
+        // an empty slot in the group ends the probe sequence
+        if (matchGroup(ctrl + pos, kEmpty) != 0) {
+            return -1;
+        }
+    }
+}
+
+void Hashtable::swissInsert(const Slot& e, int hK, signed char tag) {
+    for (int pos = hK;; pos = (pos + kGroup) % size) {
+        unsigned int m = matchGroup(ctrl + pos, kEmpty) | matchGroup(ctrl + pos, kDeleted);
+        if (m != 0) {
+            int index = (pos + __builtin_ctz(m)) % size;
+            if (ctrl[index] == kDeleted) {
+                tombs -= 1;
+            }
+            h[index] = e;
+            setCtrl(index, tag);
+            return;
+        }
+    }
+}
+
+void Hashtable::setCtrl(int index, signed char c) {
+    ctrl[index] = c;
+    // the bytes past the end mirror the start so a group can be loaded at any slot
+    for (int i = index; i < kGroup - 1; i += size) {
+        ctrl[size + i] = c;
+    }
+}
+
+/**
+ * A cuckoo table is size / kBucket buckets of kBucket slots followed by a
+ * stash of the kStash or more slots left over. Every key lives in one of
+ * its two buckets, or in the stash. A bucket's slots take two cache lines,
+ * but its fingerprints take a quarter of one, so a lookup compares those
+ * first: a miss reads two lines while the stash is empty, and a hit one
+ * more for its slot.
+ */
+void Hashtable::cuckooBuckets(unsigned long long hash, int& b1, int& b2) const {
+    static_assert(kCacheLine % (kBucket * sizeof(uint32_t)) == 0, "a bucket's fingerprints share a cache line");
+    unsigned long long buckets = (size - kStash) / kBucket;
+    // the halves home() and doubleHash() use, each mapped onto the buckets
+    b1 = (int)(((hash >> 32) * buckets) >> 32);
+    b2 = (int)(((hash & 0xFFFFFFFFULL) * buckets) >> 32);
+}
+
+int Hashtable::cuckooFind(const SmallKey& k, unsigned long long hash) const {
+    int b[2];
+    cuckooBuckets(hash, b[0], b[1]);
+    uint32_t p = printOf(hash);
+    for (int j = 0; j < 2; j++) {
+        for (int index = b[j] * kBucket; index < (b[j] + 1) * kBucket; index++) {
+            if (prints[index] == p && h[index].hash == hash && h[index].key == k) {
+                return index;
+            }
+        }
+    }
+    // the stash is only scanned while something is in it
+    if (stashed > 0) {
+        for (int index = (size - kStash) / kBucket * kBucket; index < size; index++) {
+            if (prints[index] == p && h[index].key == k) {
+                return index;
+            }
+        }
+    }
+    return -1;
+}
+
+/**
+ * Puts e in a free slot of one of its buckets. If both are full, searches
+ * breadth first for the shortest chain of keys that each move to their
+ * other bucket and ends at a free slot, then shifts the chain along it.
+ * Returns false if neither that nor the stash has room.
+ */
+bool Hashtable::cuckooInsert(const Slot& e) {
+    struct Step {
+        int index;   // slot whose key would move to its other bucket
+        int parent;  // step whose key would move into index, -1 for e
+    };
+    int b[2];
+    cuckooBuckets(e.hash, b[0], b[1]);
+    vector<Step> queue;
+    for (int j = 0; j < 2; j++) {
+        for (int index = b[j] * kBucket; index < (b[j] + 1) * kBucket; index++) {
+            if (prints[index] == 0) {
+                h[index] = e;
+                prints[index] = printOf(e.hash);
+                return true;
+            }
+            queue.push_back(Step{index, -1});
+        }
+    }
+
+    for (size_t q = 0; q < queue.size() && q < kMaxEvictions; q++) {
+        int o1, o2;
+        cuckooBuckets(h[queue[q].index].hash, o1, o2);
+        int alt = queue[q].index / kBucket == o1 ? o2 : o1;
+        for (int index = alt * kBucket; index < (alt + 1) * kBucket; index++) {
+            bool onPath = false;  // a slot cannot be emptied twice on one path
+            for (int p = (int)q; p >= 0 && !onPath; p = queue[p].parent) {
+                onPath = queue[p].index == index;
+            }
+            if (onPath) {
+                continue;
+            }
+            if (prints[index] == 0) {
+                // each key on the path moves one step along it, freeing the first slot for e
+                int to = index;
+                for (int p = (int)q; p >= 0; p = queue[p].parent) {
+                    h[to] = h[queue[p].index];
+                    prints[to] = prints[queue[p].index];
+                    to = queue[p].index;
+                }
+                h[to] = e;
+                prints[to] = printOf(e.hash);
+                return true;
+            }
+            queue.push_back(Step{index, (int)q});
+        }
+    }
+
+    for (int index = (size - kStash) / kBucket * kBucket; index < size; index++) {
+        if (prints[index] == 0) {
+            h[index] = e;
+            prints[index] = printOf(e.hash);
+            stashed += 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+int Hashtable::getIndex(int& hK, const SmallKey& k, int& i, int& hK2, const int temp) const {
+    if (h[hK].count == 0 && !h[hK].deleted)
         return -1;  // empty
-    else if (h[hK]->first == k)
+    else if (h[hK].count != 0 && h[hK].key == k)
         return hK;  // // found
 
+    hK = probeAt(temp, ++i, hK2);
+    return getIndex(hK, k, i, hK2, temp);
+}
+
+// the i-th slot of the probe sequence starting at temp
+int Hashtable::probeAt(int temp, int i, int hK2) const {
     if (probeType == 0)  // linear
     {
-        hK = (temp + (++i)) % size;
+        return (int)(((long long)temp + i) % size);
     } else if (probeType == 1)  // quadratic
     {
-        hK = (temp + ((int)pow(++i, 2))) % size;
+        return (int)(((long long)temp + (long long)i * i) % size);
     } else  // double hashing
     {
-        hK = (temp + (++i * hK2)) % size;
-    }
-    return getIndex(hK, k, i, hK2, temp);
-}
-
-string Hashtable::reverseString(string& k) const {
-    string rString;
-
-    for (size_t i = 0; i < k.length(); i++) {
-        rString += k[k.length() - i - 1];
+        return (int)(((long long)temp + (long long)i * hK2) % size);
     }
-
-    return rString;
 }
 
-int Hashtable::getW(const string& k, const int& i) const {
-    int x = 0;
+unsigned long long Hashtable::getW(const char* k, size_t len, int i) const {
+    unsigned long long x = 0;
+    unsigned long long pow26 = 1;
+    // walks the reversed key without building it: reversed index j is k[len - 1 - j]
     for (int j = 0; j < 6; j++)  // calcaulte w values and store in x
     {
-        if ((unsigned int)(j + (i * 6)) < k.length()) {
-            x += (k[j + (i * 6)] - 'a') * pow(26, j);
+        size_t rIndex = (size_t)(j + (i * 6));
+        if (rIndex < len) {
+            // unsigned throughout, a byte below 'a' wraps instead of overflowing
+            x += ((unsigned long long)(unsigned char)k[len - 1 - rIndex] - 'a') * pow26;
+            pow26 *= 26;
         } else
             return x;
     }
@@ -107,71 +589,171 @@ int Hashtable::getW(const string& k, const int& i) const {
     return x;
 }
 
-int Hashtable::hash(string k) const {
-    long long hOfK = 0;
-    int w[5] = {0};
-    string rString = reverseString(k);
+unsigned long long Hashtable::fullHash(const SmallKey& k) const {
+    unsigned long long hOfK = 0;
+    unsigned long long w[5] = {0};
+    size_t len = k.size();
+    const char* bytes = k.data();
+
+    if (probeType == 8) {
+        // the sum below counts 'a' as 0, so "b", "ab", "aab", ... share a hash and would all need the
+        // same two buckets, which no amount of growing separates; cuckoo hashes the bytes themselves
+        return hashBytes(bytes, len);
+    }
 
-    // follows writeup algorithm
-    for (int i = 0; i < (int)((rString.length() / 6.0) + 0.99); i++) {
-        w[4 - i] = getW(rString, i);
+    // follows writeup algorithm, keys past 30 letters fold back onto w[4] (mod 2^64)
+    for (int i = 0; i < (int)((len / 6.0) + 0.99); i++) {
+        w[4 - (i % 5)] += getW(bytes, len, i);
     }
 
     for (int i = 0; i < 5; i++) {
-        hOfK += ((long long)r[i] * w[i]);
+        hOfK += (unsigned long long)r[i] * w[i];
     }
 
-    return hOfK % size;
+    // so every bit of the result depends on every w
+    return mix64(hOfK);
 }
 
-int Hashtable::doubleHash(string k) const {
+// seeded alike, and both or neither cuckoo, which hashes the bytes instead
+bool Hashtable::hashesLike(const Hashtable& other) const {
+    return equal(r, r + 5, other.r) && (probeType == 8) == (other.probeType == 8);
+}
+
+int Hashtable::home(unsigned long long hash) const {
+    // multiply-shift maps the high 32 bits onto [0, size) without a division
+    return (int)(((hash >> 32) * (unsigned long long)size) >> 32);
+}
+
+int Hashtable::doubleHash(unsigned long long hash) const {
     int p = primes[arrayIt];
-    long long wSum = 0;
-    string rString = reverseString(k);
+    // in [1, p], and p < size is prime so any step visits every slot
+    return p - (int)(((hash & 0xFFFFFFFFULL) * (unsigned long long)p) >> 32);
+}
 
-    // follow write up algorithm
-    for (int i = 0; i < (int)((rString.length() / 6.0) + 0.99); i++) {
-        wSum += getW(rString, i);
+void Hashtable::resize() {
+    growTo(arrayIt + 1);
+}
+
+void Hashtable::reserve(int expected) {
+    // smallest size on the ladder that keeps expected words under half full
+    int it = arrayIt;
+    while (it < 27 && (double)expected / sizes[it] >= 0.5) {
+        it++;
     }
+    if (it > arrayIt) {
+        growTo(it);
+    }
+}
 
-    return p - (wSum % p);
+int Hashtable::distinct() const {
+    return n;
 }
 
-void Hashtable::resize() {
+size_t Hashtable::bytes() const {
+    size_t total = size * sizeof(Slot) + ownKeys.bytes();
+    if (dist != nullptr) {
+        total += size * sizeof(int);
+    }
+    if (ctrl != nullptr) {
+        total += size + kGroup - 1;
+    }
+    if (prints != nullptr) {
+        total += size * sizeof(uint32_t);
+    }
+    return total;
+}
+
+FrozenTable Hashtable::freeze() const {
+    vector<pair<string, int> > items;
+    items.reserve(n);
+    forEach([&](const SmallKey& k, int c) { items.push_back(make_pair(k.str(), c)); });
+    return FrozenTable::build(items);
+}
+
+void Hashtable::growTo(int newIt) {
+    if (newIt >= (int)(sizeof(sizes) / sizeof(sizes[0]))) {
+        throw length_error("Hashtable: no size past " + to_string(size) + " slots");
+    }
+
     // update member variables
-    resized = true;
-    n = 0;
     int oldSize = size;
-    size = sizes[++arrayIt];
+    arrayIt = newIt;
+    size = sizes[arrayIt];
 
-    if (!d) {
-        for (int i = 0; i < 5; i++) {
-            r[i] = rand() % size;
-        }
+    // grab old hashtable
+    Slot* buf = h;
+    h = allocSlots(size);
+    rebuild(buf, oldSize);
+}
+
+void Hashtable::rebuild(Slot* buf, int oldSize) {
+    if (probeType == 4) {
+        delete[] dist;
+        dist = new int[size]();
+    } else if (probeType == 5) {
+        delete[] ctrl;
+        ctrl = new signed char[size + kGroup - 1];
+        fill(ctrl, ctrl + size + kGroup - 1, kEmpty);
+    } else if (probeType == 8) {
+        free(prints);
+        prints = allocPrints(size);
+        stashed = 0;  // stashed keys are in buf too, and are placed again with the rest
     }
 
-    // grab old hashtable
-    pair<std::string, int>** buf = h;
-    h = new pair<string, int>*[size]();
+    tombs = 0;  // deleted slots are not copied
 
-    // loop thru old hashtable, add to new hashtable
+    // loop thru old hashtable, move each slot to the new hashtable
+    // keys stay where they are in the arena and their cached hash is still valid,
+    // only the fixed-size records move
     for (int i = 0; i < oldSize; i++) {
-        if (buf[i] != nullptr) {
-            oldNum = buf[i]->second;
-            this->add(buf[i]->first);
-            delete buf[i];  // deallocate old hashtable
-            oldNum = 0;
+        if (buf[i].count != 0) {
+            place(buf[i]);
         }
     }
-    resized = false;
-    delete[] buf;
+    freeSlots(buf, oldSize);
+}
+
+/**
+ * Zeroed slots, all empty. With huge set, arrays of 2 MiB and up are mapped
+ * by allocLarge() and left unwritten, so their pages are placed by the
+ * thread that first fills them.
+ */
+Hashtable::Slot* Hashtable::allocSlots(int count, bool interleave) {
+    // an all-zero Slot is an empty one, and none needs destroying
+    static_assert(is_trivially_destructible<Slot>::value, "mapped slots are never destroyed");
+    static_assert(kCacheLine % sizeof(Slot) == 0, "a slot never straddles a cache line");
+    size_t bytes = count * sizeof(Slot);
+    void* p = NULL;
+    if (huge && bytes >= kHugePage) {
+        p = allocLarge(bytes, true, interleave);
+    } else if (posix_memalign(&p, kCacheLine, bytes) == 0) {
+        memset(p, 0, bytes);
+    } else {
+        p = NULL;
+    }
+    if (p == NULL) {
+        throw bad_alloc();  // as new would, freeSlots() could not tell the two apart
+    }
+    return static_cast<Slot*>(p);
+}
+
+void Hashtable::freeSlots(Slot* slots, int count) {
+    if (slots == nullptr) {
+        return;
+    }
+    size_t bytes = count * sizeof(Slot);
+    if (huge && bytes >= kHugePage) {
+        freeLarge(slots, bytes);
+    } else {
+        free(slots);
+    }
 }
 
 void Hashtable::reportAll(ostream& os) const {
     // outputs every key value pair in hashtable
     for (int i = 0; i < size; i++) {
-        if (h[i] != nullptr) {
-            os << h[i]->first << " " << h[i]->second << endl;
+        if (h[i].count != 0) {
+            os << h[i].key << " " << h[i].count << endl;
         }
     }
 }
\ No newline at end of file
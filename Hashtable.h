@@ -1,32 +1,81 @@
+#include "FrozenTable.h"
+#include "SmallKey.h"
+
+#include <cstdint>
 #include <cstdlib>
 #include <ostream>
 #include <string>
+#include <vector>
 
 class Hashtable {
 public:
-    Hashtable(bool debug = false, unsigned int probing = 0);
+    Hashtable(bool debug = false, unsigned int probing = 0, StringArena* arena = nullptr, bool hugePages = false);
     ~Hashtable();
     void add(std::string k);
-    int count(std::string k);
+    int count(std::string k) const;
+    void addBatch(const std::string* ks, size_t num);
+    void countBatch(const std::string* ks, size_t num, int* out) const;
+    void remove(std::string k);
+    void merge(const Hashtable& other);  // adds other's counts, presized for both tables' words
+    void mergeAll(const std::vector<const Hashtable*>& others, unsigned int threads = 0);
+    void reserve(int expected);  // jumps straight to the size that holds expected words
+    int distinct() const;        // number of different words
+    size_t bytes() const;        // slots, side arrays and owned key bytes
+    FrozenTable freeze() const;  // read-only copy with one probe per count()
     void reportAll(std::ostream& os) const;
+    template<typename F>
+    void forEach(F f) const;  // calls f(const SmallKey&, int) for every word and count
 
 private:
-    int hash(std::string k) const;                       // h1(k)
-    int doubleHash(std::string k) const;                 // h2(k)
-    int getW(const std::string& k, const int& i) const;  // gets w1-w5 array
-    bool insert(int& hK, const std::string& k);
-    int getIndex(int& hK, const std::string& k, int& i, int& hK2, const int temp) const;
+    struct Slot {
+        SmallKey key;                 // inline up to 15 bytes, longer keys live in the arena
+        unsigned long long hash = 0;  // fullHash(key), independent of size
+        int count = 0;                // 0 marks an empty slot
+        bool deleted = false;         // emptied by remove(), probe modes 0-2 walk past it
+    };
+
+    unsigned long long fullHash(const SmallKey& k) const;     // h1(k) before reduction
+    bool hashesLike(const Hashtable& other) const;            // other's cached hashes are valid here
+    int home(unsigned long long hash) const;                  // h1(k), reduced to a slot
+    int doubleHash(unsigned long long hash) const;            // h2(k)
+    unsigned long long getW(const char* k, size_t len, int i) const;  // gets w1-w5 of the reversed key
+    static const int kBatchWindow = 32;  // keys hashed and prefetched ahead of their probes
+
+    int find(const SmallKey& key, unsigned long long hash) const;
+    void addHashed(const SmallKey& key, unsigned long long hK, int c = 1);
+    void makeRoom(int more);
+    void prefetch(unsigned long long hash) const;
+    void place(const Slot& s);
+    int getIndex(int& hK, const SmallKey& k, int& i, int& hK2, const int temp) const;
+    int probeAt(int temp, int i, int hK2) const;
     void resize();
-    std::string reverseString(std::string& k) const;
+    Slot* allocSlots(int count, bool interleave = false);
+    void freeSlots(Slot* slots, int count);
+    void growTo(int newIt);
+    void rebuild(Slot* buf, int oldSize);
+    int robinFind(const SmallKey& k, int hK) const;
+    void robinInsert(Slot e, int hK);
+    int swissFind(const SmallKey& k, int hK, signed char tag) const;
+    void swissInsert(const Slot& e, int hK, signed char tag);
+    void setCtrl(int index, signed char c);
+    void cuckooBuckets(unsigned long long hash, int& b1, int& b2) const;
+    int cuckooFind(const SmallKey& k, unsigned long long hash) const;
+    bool cuckooInsert(const Slot& e);
 
     bool d;                           // debug
     unsigned int probeType;           // probing
-    std::pair<std::string, int>** h;  // Hashtable array
+    bool huge;                        // slot arrays of 2 MiB and up get huge pages (LargePages.h)
+    Slot* h;                          // Hashtable array
+    StringArena ownKeys;              // used when no shared arena is passed in
+    StringArena* keys;                // interns the bytes of keys too long to store inline
+    int* dist = nullptr;              // probe distance of each slot, robin hood only
+    signed char* ctrl = nullptr;      // 7-bit hash tags + 15 mirrored bytes, swiss only
+    uint32_t* prints = nullptr;       // fingerprint of each slot, 0 when empty, cuckoo only
+    int tombs = 0;                    // deleted slots, or control bytes for swiss
+    int stashed = 0;                  // keys in the stash, cuckoo only
     int n = 0;                        // # items in hashtable, used for calculating loading factor
     int size;                         // # indices in hashtable
     int arrayIt = 0;
-    bool resized = false;
-    int oldNum = 0;
 
     int sizes[28]
             = {11,       23,       47,       97,        197,       397,       797,       1597,      3203,    6421,
@@ -40,3 +89,12 @@ private:
     int r[5] =  // for debug mode "random" numbers
             {983132572, 62337998, 552714139, 984953261, 261934300};
 };
+
+template<typename F>
+void Hashtable::forEach(F f) const {
+    for (int i = 0; i < size; i++) {
+        if (h[i].count != 0) {
+            f(h[i].key, h[i].count);
+        }
+    }
+}
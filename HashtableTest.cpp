@@ -0,0 +1,64 @@
+#include "Hashtable.h"
+
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+/*
+  Regression tests for Hashtable, run with make test. Each check prints
+  what went wrong and the program returns 1 if any failed.
+*/
+
+int failures = 0;
+
+void check(bool ok, const string& what) {
+    if (!ok) {
+        cout << "FAILED: " << what << endl;
+        failures++;
+    }
+}
+
+/**
+ * The writeup hash counts 'a' as 0, so "a", "aa", "aaa", ... and "b", "ab",
+ * "aab", ... each share one hash. Cuckoo hashing (type 8) used to send a
+ * whole family to the same two buckets and grow until allocation failed.
+ */
+void countsLeadingAFamilies(unsigned int probeType) {
+    const int kLongest = 200;
+    Hashtable ht(false, probeType);
+    for (int len = 1; len <= kLongest; len++) {
+        for (int rep = 0; rep < len % 3 + 1; rep++) {
+            ht.add(string(len, 'a'));
+        }
+        ht.add(string(len - 1, 'a') + "b");
+    }
+
+    string type = " under probe type " + to_string(probeType);
+    check(ht.distinct() == 2 * kLongest, "distinct words" + type);
+    for (int len = 1; len <= kLongest; len++) {
+        string word(len, 'a');
+        check(ht.count(word) == len % 3 + 1, "count of " + to_string(len) + " a's" + type);
+        check(ht.count(string(len - 1, 'a') + "b") == 1, "count of " + to_string(len - 1) + " a's and a b" + type);
+    }
+    check(ht.count(string(kLongest + 1, 'a')) == 0, "count of a word never added" + type);
+
+    for (int len = 1; len <= kLongest; len += 2) {
+        ht.remove(string(len, 'a'));
+    }
+    check(ht.distinct() == 2 * kLongest - kLongest / 2, "distinct words after remove" + type);
+    check(ht.count("a") == 0 && ht.count("aa") == 2 % 3 + 1, "counts after remove" + type);
+}
+
+int main() {
+    unsigned int types[] = {0, 2, 4, 5, 8};
+    for (unsigned int t : types) {
+        countsLeadingAFamilies(t);
+    }
+    if (failures > 0) {
+        cout << failures << " checks failed" << endl;
+        return 1;
+    }
+    cout << "all checks passed" << endl;
+    return 0;
+}
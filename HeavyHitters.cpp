@@ -0,0 +1,195 @@
+#include "HeavyHitters.h"
+
+#include "Hash.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+CountMinSketch::CountMinSketch(double eps, double delta)
+        : CountMinSketch((size_t)ceil(exp(1.0) / eps), (size_t)ceil(log(1.0 / delta))) {}
+
+CountMinSketch::CountMinSketch(size_t width, size_t depth)
+        : w(max(width, (size_t)1)), d(max(depth, (size_t)1)), table(w * d, 0) {}
+
+size_t CountMinSketch::cell(uint64_t hash, size_t row) const {
+    // row i hashes with h1 + i * h2 (Kirsch-Mitzenmacher), reduced by multiply-shift
+    uint32_t h = (uint32_t)(hash >> 32) + (uint32_t)row * ((uint32_t)hash | 1);
+    return row * w + (size_t)(((uint64_t)h * w) >> 32);
+}
+
+unsigned int CountMinSketch::add(const string& k, unsigned int c) {
+    uint64_t hash = hashBytes(k.data(), k.length());
+    unsigned int low = estimate(k);
+    n += c;
+
+    // conservative update: only raise counters that would fall below the new estimate
+    for (size_t i = 0; i < d; i++) {
+        unsigned int& counter = table[cell(hash, i)];
+        counter = max(counter, low + c);
+    }
+    return low + c;
+}
+
+unsigned int CountMinSketch::estimate(const string& k) const {
+    uint64_t hash = hashBytes(k.data(), k.length());
+    unsigned int low = table[cell(hash, 0)];
+    for (size_t i = 1; i < d; i++) {
+        low = min(low, table[cell(hash, i)]);
+    }
+    return low;
+}
+
+size_t CountMinSketch::width() const {
+    return w;
+}
+
+size_t CountMinSketch::depth() const {
+    return d;
+}
+
+size_t CountMinSketch::bytes() const {
+    return table.size() * sizeof(unsigned int);
+}
+
+unsigned long long CountMinSketch::total() const {
+    return n;
+}
+
+SpaceSaving::SpaceSaving(size_t k) : k(max(k, (size_t)1)) {
+    heap.reserve(this->k);
+    where.reserve(this->k);
+}
+
+void SpaceSaving::add(const string& key, unsigned int c, unsigned long long bound) {
+    unordered_map<string, size_t>::iterator it = where.find(key);
+    if (it != where.end()) {
+        Counter& counter = heap[it->second];
+        counter.count = min(counter.count + c, bound);
+        counter.error = min(counter.error, counter.count - c);
+        siftDown(it->second);
+        return;
+    }
+
+    if (heap.size() < k) {
+        Counter fresh = {key, c, 0};
+        heap.push_back(fresh);
+        where[key] = heap.size() - 1;
+        // a new counter of c is at most its parent only if c is the smallest, sift up
+        size_t i = heap.size() - 1;
+        while (i > 0 && heap[(i - 1) / 2].count > heap[i].count) {
+            swapCounters(i, (i - 1) / 2);
+            i = (i - 1) / 2;
+        }
+        return;
+    }
+
+    // evict the smallest counter, the new word inherits its count as error
+    // (or starts from the outside bound when there is one)
+    where.erase(heap[0].key);
+    heap[0].key = key;
+    heap[0].count = bound != ~0ULL ? bound : heap[0].count + c;
+    heap[0].error = heap[0].count - c;
+    where[key] = 0;
+    siftDown(0);
+}
+
+const SpaceSaving::Counter* SpaceSaving::find(const string& key) const {
+    unordered_map<string, size_t>::const_iterator it = where.find(key);
+    return it == where.end() ? NULL : &heap[it->second];
+}
+
+vector<SpaceSaving::Counter> SpaceSaving::top() const {
+    vector<Counter> sorted(heap);
+    sort(sorted.begin(), sorted.end(), [](const Counter& a, const Counter& b) {
+        return a.count > b.count || (a.count == b.count && a.key < b.key);
+    });
+    return sorted;
+}
+
+size_t SpaceSaving::capacity() const {
+    return k;
+}
+
+size_t SpaceSaving::bytes() const {
+    size_t total = heap.capacity() * sizeof(Counter) + where.bucket_count() * sizeof(void*);
+    for (size_t i = 0; i < heap.size(); i++) {
+        // each key is held by the heap and by the map
+        total += 2 * heap[i].key.capacity() + sizeof(pair<string, size_t>) + sizeof(void*);
+    }
+    return total;
+}
+
+void SpaceSaving::siftDown(size_t i) {
+    while (true) {
+        size_t smallest = i;
+        size_t l = 2 * i + 1;
+        size_t r = 2 * i + 2;
+        if (l < heap.size() && heap[l].count < heap[smallest].count) {
+            smallest = l;
+        }
+        if (r < heap.size() && heap[r].count < heap[smallest].count) {
+            smallest = r;
+        }
+        if (smallest == i) {
+            return;
+        }
+        swapCounters(i, smallest);
+        i = smallest;
+    }
+}
+
+void SpaceSaving::swapCounters(size_t i, size_t j) {
+    swap(heap[i], heap[j]);
+    where[heap[i].key] = i;
+    where[heap[j].key] = j;
+}
+
+HeavyHitters::HeavyHitters(size_t k, double eps, double delta)
+        : sketch(eps, delta), summary(k), eps(eps), delta(delta) {}
+
+void HeavyHitters::add(const string& k) {
+    summary.add(k, 1, sketch.add(k));
+}
+
+unsigned long long HeavyHitters::estimate(const string& k) const {
+    unsigned long long e = sketch.estimate(k);
+    const SpaceSaving::Counter* c = summary.find(k);
+    if (c != NULL) {
+        e = min(e, c->count);
+    }
+    return e;
+}
+
+vector<pair<string, unsigned long long> > HeavyHitters::top() const {
+    vector<SpaceSaving::Counter> counters = summary.top();
+    vector<pair<string, unsigned long long> > result;
+    for (size_t i = 0; i < counters.size(); i++) {
+        result.push_back(make_pair(counters[i].key, estimate(counters[i].key)));
+    }
+    stable_sort(
+            result.begin(),
+            result.end(),
+            [](const pair<string, unsigned long long>& a, const pair<string, unsigned long long>& b) {
+                return a.second > b.second;
+            });
+    return result;
+}
+
+size_t HeavyHitters::bytes() const {
+    return sketch.bytes() + summary.bytes();
+}
+
+void HeavyHitters::reportAll(ostream& os) const {
+    unsigned long long n = sketch.total();
+    os << "Count-Min Sketch " << sketch.depth() << " x " << sketch.width() << ", Space-Saving top "
+       << summary.capacity() << ", about " << bytes() << " bytes" << endl;
+    os << "Estimates overcount by at most " << eps * n << " (eps " << eps << " x " << n << " words) with probability "
+       << 1 - delta << endl;
+    os << "Every word occurring more than " << n / summary.capacity() + eps * n << " times is listed" << endl << endl;
+
+    vector<pair<string, unsigned long long> > words = top();
+    for (size_t i = 0; i < words.size(); i++) {
+        os << words[i].first << " " << words[i].second << endl;
+    }
+}
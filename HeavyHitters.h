@@ -0,0 +1,93 @@
+#ifndef HEAVYHITTERS_H
+#define HEAVYHITTERS_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * A Count-Min Sketch with conservative update. With width ceil(e / eps) and
+ * depth ceil(ln(1 / delta)), estimate(k) never undercounts and overcounts by
+ * more than eps * total() with probability at most delta.
+ */
+class CountMinSketch {
+public:
+    CountMinSketch(double eps, double delta);
+    CountMinSketch(size_t width, size_t depth);
+    unsigned int add(const std::string& k, unsigned int c = 1);  // returns the new estimate
+    unsigned int estimate(const std::string& k) const;
+    size_t width() const;
+    size_t depth() const;
+    size_t bytes() const;
+    unsigned long long total() const;
+
+private:
+    size_t cell(uint64_t hash, size_t row) const;
+
+    size_t w;                         // counters per row
+    size_t d;                         // rows, one hash function each
+    std::vector<unsigned int> table;  // d rows of w counters
+    unsigned long long n = 0;         // sum of every count added
+};
+
+/**
+ * Space-Saving top-k summary. Monitors at most k words; a new word evicts
+ * the one with the smallest count and inherits that count as its error.
+ * Every word occurring more than total / k times is monitored, and a
+ * monitored count overestimates by at most its error.
+ *
+ * add() optionally takes another upper bound on the word's count, such as
+ * a sketch estimate. A monitored count is clamped to it, and a newcomer
+ * starts from it instead of the evicted count. Counts stay upper bounds;
+ * words occurring more than total / k + (the bound's own overcount) times
+ * stay monitored.
+ */
+class SpaceSaving {
+public:
+    struct Counter {
+        std::string key;
+        unsigned long long count;  // upper bound on the true count
+        unsigned long long error;  // count - error is a lower bound
+    };
+
+    explicit SpaceSaving(size_t k);
+    void add(const std::string& key, unsigned int c = 1, unsigned long long bound = ~0ULL);
+    const Counter* find(const std::string& key) const;
+    std::vector<Counter> top() const;  // largest count first
+    size_t capacity() const;
+    size_t bytes() const;
+
+private:
+    void siftDown(size_t i);
+    void swapCounters(size_t i, size_t j);
+
+    size_t k;
+    std::vector<Counter> heap;                      // min-heap on count
+    std::unordered_map<std::string, size_t> where;  // heap index of each monitored word
+};
+
+/**
+ * Approximate word counting in bounded memory: a Count-Min Sketch gives an
+ * estimate for any word and a Space-Saving summary keeps the top k. A
+ * monitored word's estimate is the smaller of the two upper bounds.
+ */
+class HeavyHitters {
+public:
+    HeavyHitters(size_t k, double eps, double delta);
+    void add(const std::string& k);
+    unsigned long long estimate(const std::string& k) const;
+    std::vector<std::pair<std::string, unsigned long long> > top() const;  // largest first
+    size_t bytes() const;
+    void reportAll(std::ostream& os) const;
+
+private:
+    CountMinSketch sketch;
+    SpaceSaving summary;
+    double eps;
+    double delta;
+};
+
+#endif
@@ -0,0 +1,50 @@
+#include "HyperLogLog.h"
+
+#include "Hash.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+HyperLogLog::HyperLogLog(int precision) : p(max(4, min(precision, 18))), registers((size_t)1 << p, 0) {}
+
+void HyperLogLog::add(const string& k) {
+    uint64_t hash = hashBytes(k.data(), k.length());
+    size_t index = hash >> (64 - p);
+    // rank of the first 1 bit in the remaining 64 - p bits, the sentinel bit caps it
+    uint64_t rest = (hash << p) | ((uint64_t)1 << (p - 1));
+    unsigned char rank = (unsigned char)(__builtin_clzll(rest) + 1);
+    registers[index] = max(registers[index], rank);
+}
+
+void HyperLogLog::merge(const HyperLogLog& other) {
+    for (size_t i = 0; i < registers.size() && i < other.registers.size(); i++) {
+        registers[i] = max(registers[i], other.registers[i]);
+    }
+}
+
+double HyperLogLog::estimate() const {
+    double m = (double)registers.size();
+    double sum = 0;
+    size_t zeros = 0;
+    for (size_t i = 0; i < registers.size(); i++) {
+        sum += ldexp(1.0, -registers[i]);
+        zeros += registers[i] == 0;
+    }
+    double alpha = 0.7213 / (1 + 1.079 / m);
+    double e = alpha * m * m / sum;
+
+    // small cardinalities: linear counting on the empty registers is more accurate
+    if (e <= 2.5 * m && zeros != 0) {
+        e = m * log(m / zeros);
+    }
+    return e;
+}
+
+double HyperLogLog::standardError() const {
+    return 1.04 / sqrt((double)registers.size());
+}
+
+size_t HyperLogLog::bytes() const {
+    return registers.size();
+}
@@ -0,0 +1,119 @@
+#include "LargePages.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+namespace {
+const int kMpolInterleave = 3;  // MPOL_INTERLEAVE from linux/mempolicy.h, which needs no libnuma
+const int kMaxNodes = 64;       // nodes an interleave mask covers
+
+size_t roundUp(size_t bytes) {
+    return (bytes + kHugePage - 1) / kHugePage * kHugePage;
+}
+
+/**
+ * The online memory nodes, from a list like "0", "0-3" or "0-1,4,6-7".
+ * Node numbers can have gaps, so the highest one says nothing about how
+ * many there are. Empty if the list cannot be read.
+ */
+vector<int> onlineNodes() {
+    vector<int> nodes;
+    ifstream in("/sys/devices/system/node/online");
+    string line;
+    if (!getline(in, line)) {
+        return nodes;
+    }
+    stringstream ranges(line);
+    string range;
+    while (getline(ranges, range, ',')) {
+        if (range.empty()) {
+            continue;
+        }
+        size_t dash = range.find('-');
+        int first = atoi(range.c_str());
+        int last = dash == string::npos ? first : atoi(range.c_str() + dash + 1);
+        for (int node = first; node <= last; node++) {
+            nodes.push_back(node);
+        }
+    }
+    return nodes;
+}
+}  // namespace
+
+void* allocLarge(size_t bytes, bool hugePages, bool interleave) {
+    size_t len = roundUp(bytes);
+    void* p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (hugePages) {
+        // fails unless the administrator reserved pages in /proc/sys/vm/nr_hugepages
+        p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    }
+#endif
+    if (p == MAP_FAILED) {
+        // transparent huge pages only back 2 MiB aligned ranges, so map one page extra and trim
+        size_t over = hugePages ? len + kHugePage : len;
+        char* raw = static_cast<char*>(mmap(NULL, over, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        if (raw == MAP_FAILED) {
+            return NULL;
+        }
+        char* start = raw;
+        if (hugePages) {
+            start = reinterpret_cast<char*>(roundUp(reinterpret_cast<size_t>(raw)));
+            if (start > raw) {
+                munmap(raw, start - raw);
+            }
+            if (raw + over > start + len) {
+                munmap(start + len, raw + over - (start + len));
+            }
+#ifdef MADV_HUGEPAGE
+            madvise(start, len, MADV_HUGEPAGE);  // a hint, ignored where THP is off
+#endif
+        }
+        p = start;
+    }
+#ifdef SYS_mbind
+    vector<int> nodes = onlineNodes();
+    if (interleave && nodes.size() > 1) {
+        unsigned long mask = 0;
+        for (size_t i = 0; i < nodes.size(); i++) {
+            if (nodes[i] < kMaxNodes) {
+                mask |= 1UL << nodes[i];
+            }
+        }
+        syscall(SYS_mbind, p, len, kMpolInterleave, &mask, (unsigned long)kMaxNodes + 1, 0);
+    }
+#endif
+    return p;
+}
+
+void freeLarge(void* p, size_t bytes) {
+    if (p != NULL) {
+        munmap(p, roundUp(bytes));
+    }
+}
+
+int numaNodes() {
+    vector<int> nodes = onlineNodes();
+    return nodes.empty() ? 1 : (int)nodes.size();
+}
+
+size_t anonHugeBytes() {
+    ifstream in("/proc/self/smaps_rollup");
+    string line;
+    while (getline(in, line)) {
+        if (line.compare(0, 14, "AnonHugePages:") == 0) {
+            return strtoull(line.c_str() + 14, NULL, 10) * 1024;  // reported in kB
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,27 @@
+#ifndef LARGEPAGES_H
+#define LARGEPAGES_H
+
+#include <cstddef>
+
+/**
+ * Memory for arrays big enough that TLB misses show up in their lookups.
+ * allocLarge() maps zeroed memory rounded up to whole 2 MiB pages. With
+ * hugePages it asks for pages from the reserved hugetlbfs pool first
+ * (MAP_HUGETLB), and if none are free, maps ordinary memory aligned to
+ * 2 MiB and advises transparent huge pages for it (MADV_HUGEPAGE). Either
+ * way the memory is only placed when first written, so on a NUMA machine
+ * it lands on the node of the thread that fills it. With interleave it is
+ * spread over every node instead, for arrays every thread reads.
+ *
+ * Returns NULL if nothing could be mapped. Free with freeLarge() and the
+ * same size.
+ */
+void* allocLarge(size_t bytes, bool hugePages, bool interleave = false);
+void freeLarge(void* p, size_t bytes);
+
+const size_t kHugePage = 2 * 1024 * 1024;
+
+int numaNodes();          // memory nodes on this machine, 1 if unknown
+size_t anonHugeBytes();   // memory of this process backed by transparent huge pages
+
+#endif
@@ -0,0 +1,113 @@
+#include "PerfCounters.h"
+
+#include <cerrno>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace std;
+
+PerfCounters::PerfCounters() {}
+
+PerfCounters::~PerfCounters() {
+    for (size_t i = 0; i < counters.size(); i++) {
+        if (counters[i].fd >= 0) {
+            close(counters[i].fd);
+        }
+    }
+}
+
+bool PerfCounters::add(const string& name, uint32_t type, uint64_t config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;  // allowed at perf_event_paranoid 2, the usual default
+    attr.exclude_hv = 1;
+    attr.inherit = 1;  // so the --pipeline stages are counted too
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    Counter c;
+    c.name = name;
+    c.fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);  // this thread, any CPU
+    c.error = c.fd < 0 ? strerror(errno) : "";
+    c.value = 0;
+    counters.push_back(c);
+    return c.fd >= 0;
+}
+
+bool PerfCounters::addDTLBMisses() {
+    return add("dTLB load misses", PERF_TYPE_HW_CACHE,
+               PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                       | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+}
+
+bool PerfCounters::addPageFaults() {
+    return add("page faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS);
+}
+
+int PerfCounters::addStandard() {
+    int counted = 0;
+    counted += add("cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    counted += add("instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    counted += add("cache misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    counted += add("branch misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    counted += addDTLBMisses();
+    counted += addPageFaults();
+    return counted;
+}
+
+void PerfCounters::start() {
+    for (size_t i = 0; i < counters.size(); i++) {
+        counters[i].value = 0;
+        if (counters[i].fd >= 0) {
+            ioctl(counters[i].fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(counters[i].fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+void PerfCounters::stop() {
+    for (size_t i = 0; i < counters.size(); i++) {
+        Counter& c = counters[i];
+        if (c.fd < 0) {
+            continue;
+        }
+        ioctl(c.fd, PERF_EVENT_IOC_DISABLE, 0);
+        uint64_t data[3];  // value, time enabled, time running
+        if (read(c.fd, data, sizeof(data)) != (ssize_t)sizeof(data)) {
+            c.value = 0;
+        } else if (data[2] == 0) {
+            c.value = 0;  // never got onto the PMU
+        } else {
+            c.value = (double)data[0] * ((double)data[1] / data[2]);
+        }
+    }
+}
+
+size_t PerfCounters::size() const {
+    return counters.size();
+}
+
+bool PerfCounters::available(size_t i) const {
+    return counters[i].fd >= 0;
+}
+
+double PerfCounters::value(size_t i) const {
+    return counters[i].value;
+}
+
+void PerfCounters::report(ostream& os, double operations) const {
+    for (size_t i = 0; i < counters.size(); i++) {
+        const Counter& c = counters[i];
+        if (c.fd < 0) {
+            os << c.name << ": not available (" << c.error << ")" << endl;
+        } else {
+            os << c.name << ": " << c.value / operations << " per operation (" << (uint64_t)c.value << ")" << endl;
+        }
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * Hardware and software event counters for this thread via
+ * perf_event_open(2). Each event is opened on its own, so an event the
+ * CPU, the kernel or perf_event_paranoid will not count is reported as
+ * unavailable with the reason, and the rest still count. Counts are scaled
+ * up when the kernel had to multiplex the event with others, and include
+ * threads the counting thread starts after add().
+ */
+class PerfCounters {
+public:
+    PerfCounters();
+    ~PerfCounters();
+
+    bool add(const std::string& name, uint32_t type, uint64_t config);  // false if it cannot be counted here
+    bool addDTLBMisses();  // data TLB load misses
+    bool addPageFaults();
+    int addStandard();  // cycles, instructions, cache and branch misses, dTLB misses and page faults; returns how many count
+    void start();  // zeroes and enables every counter
+    void stop();
+
+    size_t size() const;
+    bool available(size_t i) const;
+    double value(size_t i) const;
+    void report(std::ostream& os, double operations) const;  // one line per event, per operation
+
+private:
+    struct Counter {
+        std::string name;
+        int fd;             // -1 if the event could not be opened
+        std::string error;  // why not
+        double value;
+    };
+
+    PerfCounters(const PerfCounters&);
+    PerfCounters& operator=(const PerfCounters&);
+
+    std::vector<Counter> counters;
+};
+
+#endif
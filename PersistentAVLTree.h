@@ -0,0 +1,313 @@
+#ifndef PERSISTENTAVLTREE_H
+#define PERSISTENTAVLTREE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+/**
+ * A persistent AVL tree: every version stays readable after later updates.
+ * A PersistentAVLTree is a handle on one version. Copying it, or calling
+ * snapshot(), is O(1) and shares every node.
+ *
+ * Nodes are reference counted. insert() and remove() copy only the nodes
+ * on their path that another version still shares, and update the rest in
+ * place, so a tree with no snapshots outstanding allocates nothing on an
+ * update. A node is freed when the last version using it lets go. Counts
+ * are atomic, so a snapshot may be read and dropped on another thread
+ * while the tree it came from keeps changing.
+ */
+template<class Key, class Value>
+class PersistentAVLTree {
+public:
+    PersistentAVLTree();
+    PersistentAVLTree(const PersistentAVLTree& other);  // O(1), shares every node
+    PersistentAVLTree& operator=(const PersistentAVLTree& other);
+    ~PersistentAVLTree();
+
+    PersistentAVLTree snapshot() const;  // a frozen copy of this version
+    void insert(const std::pair<const Key, Value>& item);  // replaces the value of an existing key
+    void remove(const Key& key);
+    const Value* find(const Key& key) const;  // NULL if key is not in this version
+    size_t size() const;
+    template<typename F>
+    void forEach(F f) const;  // calls f(key, value) in order
+
+private:
+    struct PNode {
+        Key key;
+        Value value;
+        PNode* left;
+        PNode* right;
+        int height;
+        std::atomic<int> refs;  // versions and parents pointing here
+
+        PNode(const Key& k, const Value& v, PNode* l, PNode* r, int h)
+                : key(k), value(v), left(l), right(r), height(h), refs(1) {}
+    };
+
+    static int heightOf(const PNode* n);
+    static void updateHeight(PNode* n);
+    static PNode* acquire(PNode* n);
+    static void release(PNode* n);
+    static PNode* own(PNode* n);
+    static PNode* rotateLeft(PNode* n);
+    static PNode* rotateRight(PNode* n);
+    static PNode* rebalance(PNode* n);
+    static PNode* insertAt(PNode* n, const Key& key, const Value& value, bool& added);
+    static PNode* removeAt(PNode* n, const Key& key);
+    static PNode* removeMin(PNode* n, PNode*& min);
+
+    PNode* root_;
+    size_t size_;
+};
+
+/*
+  ---------------------------------------------------
+  Begin implementations for the PersistentAVLTree class.
+  ---------------------------------------------------
+*/
+
+template<class Key, class Value>
+PersistentAVLTree<Key, Value>::PersistentAVLTree() : root_(NULL), size_(0) {}
+
+template<class Key, class Value>
+PersistentAVLTree<Key, Value>::PersistentAVLTree(const PersistentAVLTree& other)
+        : root_(acquire(other.root_)), size_(other.size_) {}
+
+template<class Key, class Value>
+PersistentAVLTree<Key, Value>& PersistentAVLTree<Key, Value>::operator=(const PersistentAVLTree& other) {
+    PNode* old = root_;
+    root_ = acquire(other.root_);  // before releasing, in case both share the root
+    size_ = other.size_;
+    release(old);
+    return *this;
+}
+
+template<class Key, class Value>
+PersistentAVLTree<Key, Value>::~PersistentAVLTree() {
+    release(root_);
+}
+
+template<class Key, class Value>
+PersistentAVLTree<Key, Value> PersistentAVLTree<Key, Value>::snapshot() const {
+    return *this;
+}
+
+template<class Key, class Value>
+void PersistentAVLTree<Key, Value>::insert(const std::pair<const Key, Value>& item) {
+    bool added = false;
+    root_ = insertAt(root_, item.first, item.second, added);
+    if (added) {
+        size_++;
+    }
+}
+
+template<class Key, class Value>
+void PersistentAVLTree<Key, Value>::remove(const Key& key) {
+    // a miss must not copy the shared path
+    if (find(key) == NULL) {
+        return;
+    }
+    root_ = removeAt(root_, key);
+    size_--;
+}
+
+template<class Key, class Value>
+const Value* PersistentAVLTree<Key, Value>::find(const Key& key) const {
+    const PNode* n = root_;
+    while (n != NULL) {
+        if (key < n->key) {
+            n = n->left;
+        } else if (n->key < key) {
+            n = n->right;
+        } else {
+            return &n->value;
+        }
+    }
+    return NULL;
+}
+
+template<class Key, class Value>
+size_t PersistentAVLTree<Key, Value>::size() const {
+    return size_;
+}
+
+template<class Key, class Value>
+template<typename F>
+void PersistentAVLTree<Key, Value>::forEach(F f) const {
+    std::vector<const PNode*> path;
+    const PNode* n = root_;
+    while (n != NULL || !path.empty()) {
+        while (n != NULL) {
+            path.push_back(n);
+            n = n->left;
+        }
+        n = path.back();
+        path.pop_back();
+        f(n->key, n->value);
+        n = n->right;
+    }
+}
+
+template<class Key, class Value>
+int PersistentAVLTree<Key, Value>::heightOf(const PNode* n) {
+    return n == NULL ? 0 : n->height;
+}
+
+template<class Key, class Value>
+void PersistentAVLTree<Key, Value>::updateHeight(PNode* n) {
+    n->height = std::max(heightOf(n->left), heightOf(n->right)) + 1;
+}
+
+template<class Key, class Value>
+typename PersistentAVLTree<Key, Value>::PNode* PersistentAVLTree<Key, Value>::acquire(PNode* n) {
+    if (n != NULL) {
+        n->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+    return n;
+}
+
+/**
+ * Drops one reference to n, freeing it and dropping its references to its
+ * children if it was the last. Depth is bounded by the tree height.
+ */
+template<class Key, class Value>
+void PersistentAVLTree<Key, Value>::release(PNode* n) {
+    if (n != NULL && n->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        release(n->left);
+        release(n->right);
+        delete n;
+    }
+}
+
+/**
+ * Takes a reference to n and returns a node with the same contents that
+ * only the caller references: n itself if nobody else does, else a copy
+ * sharing n's children.
+ */
+template<class Key, class Value>
+typename PersistentAVLTree<Key, Value>::PNode* PersistentAVLTree<Key, Value>::own(PNode* n) {
+    if (n->refs.load(std::memory_order_acquire) == 1) {
+        return n;
+    }
+    PNode* copy = new PNode(n->key, n->value, acquire(n->left), acquire(n->right), n->height);
+    release(n);
+    return copy;
+}
+
+/**
+ * Rotations take and return owned references, and own() the child moving
+ * up, since its links change too.
+ */
+template<class Key, class Value>
+typename PersistentAVLTree<Key, Value>::PNode* PersistentAVLTree<Key, Value>::rotateLeft(PNode* n) {
+    PNode* p = own(n->right);
+    n->right = p->left;
+    p->left = n;
+    updateHeight(n);
+    updateHeight(p);
+    return p;
+}
+
+template<class Key, class Value>
+typename PersistentAVLTree<Key, Value>::PNode* PersistentAVLTree<Key, Value>::rotateRight(PNode* n) {
+    PNode* p = own(n->left);
+    n->left = p->right;
+    p->right = n;
+    updateHeight(n);
+    updateHeight(p);
+    return p;
+}
+
+/**
+ * n is owned by the caller and its children are balanced; fixes n with the
+ * same single and double rotations as AVLTree's insertFix/removeFix.
+ */
+template<class Key, class Value>
+typename PersistentAVLTree<Key, Value>::PNode* PersistentAVLTree<Key, Value>::rebalance(PNode* n) {
+    int diff = heightOf(n->left) - heightOf(n->right);
+    if (diff > 1) {
+        if (heightOf(n->left->left) < heightOf(n->left->right)) {
+            n->left = rotateLeft(own(n->left));  // zig-zag
+        }
+        return rotateRight(n);
+    } else if (diff < -1) {
+        if (heightOf(n->right->right) < heightOf(n->right->left)) {
+            n->right = rotateRight(own(n->right));
+        }
+        return rotateLeft(n);
+    }
+    updateHeight(n);
+    return n;
+}
+
+template<class Key, class Value>
+typename PersistentAVLTree<Key, Value>::PNode*
+PersistentAVLTree<Key, Value>::insertAt(PNode* n, const Key& key, const Value& value, bool& added) {
+    if (n == NULL) {
+        added = true;
+        return new PNode(key, value, NULL, NULL, 1);
+    }
+    n = own(n);
+    if (key < n->key) {
+        n->left = insertAt(n->left, key, value, added);
+    } else if (n->key < key) {
+        n->right = insertAt(n->right, key, value, added);
+    } else {
+        n->value = value;
+        return n;
+    }
+    return rebalance(n);
+}
+
+/**
+ * key must be under n.
+ */
+template<class Key, class Value>
+typename PersistentAVLTree<Key, Value>::PNode* PersistentAVLTree<Key, Value>::removeAt(PNode* n, const Key& key) {
+    n = own(n);
+    if (key < n->key) {
+        n->left = removeAt(n->left, key);
+    } else if (n->key < key) {
+        n->right = removeAt(n->right, key);
+    } else if (n->left == NULL || n->right == NULL) {
+        // hand n's only child up and drop n
+        PNode* child = n->left != NULL ? n->left : n->right;
+        n->left = NULL;
+        n->right = NULL;
+        release(n);
+        return child;
+    } else {
+        // the successor's item takes n's place
+        PNode* min = NULL;
+        n->right = removeMin(n->right, min);
+        n->key = min->key;
+        n->value = min->value;
+        release(min);
+    }
+    return rebalance(n);
+}
+
+template<class Key, class Value>
+typename PersistentAVLTree<Key, Value>::PNode* PersistentAVLTree<Key, Value>::removeMin(PNode* n, PNode*& min) {
+    n = own(n);
+    if (n->left == NULL) {
+        PNode* right = n->right;
+        n->right = NULL;
+        min = n;
+        return right;
+    }
+    n->left = removeMin(n->left, min);
+    return rebalance(n);
+}
+
+/*
+  -------------------------------------------------
+  End implementations for the PersistentAVLTree class.
+  -------------------------------------------------
+*/
+
+#endif
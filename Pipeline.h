@@ -0,0 +1,224 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "SpscRing.h"
+#include "Tokenizer.h"
+
+#include <cerrno>
+#include <chrono>
+#include <fcntl.h>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * What each stage of runPipeline() did. Stage throughput is measured over
+ * the time the stage spent working, not waiting on its queues, so the
+ * slowest stage is the one bounding the pipeline.
+ */
+struct PipelineStats {
+    size_t bytes = 0;              // read by the reader
+    size_t words = 0;              // tokenized and counted
+    double readSeconds = 0;        // reader inside read()/pread()
+    double tokenizeSeconds = 0;    // tokenizer inside Tokenizer::feed()
+    double countSeconds = 0;       // counter inside countWord
+    double wallSeconds = 0;        // whole pipeline, start to join
+    double blockOccupancy = 0;     // average blocks queued when the tokenizer pops one
+    double batchOccupancy = 0;     // average batches queued when the counter pops one
+    size_t blockCapacity = 0;
+    size_t batchCapacity = 0;
+
+    void report(std::ostream& os) const;
+};
+
+namespace pipeline {
+const size_t kBlockSize = 64 * 1024;  // bytes per read
+const size_t kBlocks = 8;             // blocks in flight between reader and tokenizer
+const size_t kBatchWords = 1024;      // words per batch handed to the counter
+const size_t kBatches = 8;            // batches in flight between tokenizer and counter
+
+struct Block {
+    char* data;
+    size_t len;  // 0 marks the end of the input
+};
+
+struct TokenBatch {
+    std::vector<std::string> words;  // strings are reused, so steady state does not allocate
+    size_t n = 0;
+    bool last = false;
+};
+
+typedef std::chrono::steady_clock Clock;
+
+inline double since(Clock::time_point t) {
+    return std::chrono::duration<double>(Clock::now() - t).count();
+}
+}  // namespace pipeline
+
+/**
+ * Counts the words of path ("-" for stdin) with three threads: a reader
+ * doing pread() (read() for stdin) into a fixed pool of blocks, a
+ * tokenizer turning blocks into batches of words, and the calling thread
+ * running countWord on every word. The stages hand blocks and batches over
+ * lock-free single-producer/single-consumer rings, and return them over a
+ * second ring each so memory stays at the fixed pools. Returns false if
+ * the input cannot be opened or a read fails; the words before a failed
+ * read are still counted.
+ */
+template<typename CountWord>
+bool runPipeline(const char* path, CountWord countWord, PipelineStats& stats) {
+    using namespace pipeline;
+
+    bool fromStdin = std::string(path) == "-";
+    int fd = fromStdin ? 0 : open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    std::vector<std::vector<char> > blockMem(kBlocks, std::vector<char>(kBlockSize));
+    std::vector<TokenBatch> batchMem(kBatches);
+    SpscRing<Block> fullBlocks(kBlocks), freeBlocks(kBlocks);
+    SpscRing<TokenBatch*> fullBatches(kBatches), freeBatches(kBatches);
+    for (size_t i = 0; i < kBlocks; i++) {
+        Block b = {&blockMem[i][0], 0};
+        freeBlocks.push(b);
+    }
+    for (size_t i = 0; i < kBatches; i++) {
+        batchMem[i].words.resize(kBatchWords);
+        freeBatches.push(&batchMem[i]);
+    }
+
+    Clock::time_point wall = Clock::now();
+    bool readFailed = false;  // written by the reader, read after joining it
+
+    std::thread reader([&]() {
+        off_t offset = 0;
+        while (true) {
+            Block b;
+            while (!freeBlocks.pop(b)) {
+                std::this_thread::yield();
+            }
+            Clock::time_point t = Clock::now();
+            ssize_t got;
+            do {
+                got = fromStdin ? read(fd, b.data, kBlockSize) : pread(fd, b.data, kBlockSize, offset);
+            } while (got < 0 && errno == EINTR);
+            stats.readSeconds += since(t);
+
+            if (got < 0) {
+                readFailed = true;  // ends the input like EOF, the caller hears of it
+            }
+            b.len = got > 0 ? (size_t)got : 0;
+            offset += b.len;
+            stats.bytes += b.len;
+            while (!fullBlocks.push(b)) {
+                std::this_thread::yield();
+            }
+            if (b.len == 0) {
+                return;
+            }
+        }
+    });
+
+    std::thread tokenizer([&]() {
+        Tokenizer tokens;
+        TokenBatch* cur = NULL;
+        size_t samples = 0;
+        double queued = 0;
+
+        auto ship = [&](bool last) {
+            cur->last = last;
+            while (!fullBatches.push(cur)) {
+                std::this_thread::yield();
+            }
+            cur = NULL;
+        };
+        auto emit = [&](const std::string& w) {
+            if (cur == NULL) {
+                while (!freeBatches.pop(cur)) {
+                    std::this_thread::yield();
+                }
+                cur->n = 0;
+            }
+            cur->words[cur->n++] = w;
+            if (cur->n == kBatchWords) {
+                ship(false);
+            }
+        };
+
+        while (true) {
+            Block b;
+            while (!fullBlocks.pop(b)) {
+                std::this_thread::yield();
+            }
+            queued += fullBlocks.size() + 1;
+            samples++;
+            if (b.len == 0) {
+                break;
+            }
+            Clock::time_point t = Clock::now();
+            tokens.feed(b.data, b.len, emit);
+            stats.tokenizeSeconds += since(t);
+            freeBlocks.push(b);
+        }
+        tokens.finish(emit);
+        if (cur == NULL) {
+            while (!freeBatches.pop(cur)) {
+                std::this_thread::yield();
+            }
+            cur->n = 0;
+        }
+        ship(true);
+        stats.blockOccupancy = queued / samples;
+    });
+
+    size_t samples = 0;
+    double queued = 0;
+    while (true) {
+        TokenBatch* batch;
+        while (!fullBatches.pop(batch)) {
+            std::this_thread::yield();
+        }
+        queued += fullBatches.size() + 1;
+        samples++;
+        Clock::time_point t = Clock::now();
+        for (size_t i = 0; i < batch->n; i++) {
+            countWord(batch->words[i]);
+        }
+        stats.countSeconds += since(t);
+        stats.words += batch->n;
+        bool last = batch->last;
+        freeBatches.push(batch);
+        if (last) {
+            break;
+        }
+    }
+    stats.batchOccupancy = queued / samples;  // the last batch makes samples at least 1
+
+    reader.join();
+    tokenizer.join();
+    stats.wallSeconds = since(wall);
+    stats.blockCapacity = fullBlocks.capacity();
+    stats.batchCapacity = fullBatches.capacity();
+    if (!fromStdin) {
+        close(fd);
+    }
+    return !readFailed;
+}
+
+inline void PipelineStats::report(std::ostream& os) const {
+    // empty input leaves nothing to divide by
+    auto rate = [](double amount, double seconds) { return seconds > 0 ? amount / seconds : 0.0; };
+    os << "Pipeline (wall clock, " << wallSeconds << " s)" << std::endl;
+    os << "reader: " << rate(bytes / 1e6, readSeconds) << " MB/s busy for " << readSeconds << " s" << std::endl;
+    os << "tokenizer: " << rate(words, tokenizeSeconds) << " words/s busy for " << tokenizeSeconds << " s"
+       << std::endl;
+    os << "counter: " << rate(words, countSeconds) << " words/s busy for " << countSeconds << " s" << std::endl;
+    os << "block queue: " << blockOccupancy << " of " << blockCapacity << " queued on average" << std::endl;
+    os << "batch queue: " << batchOccupancy << " of " << batchCapacity << " queued on average" << std::endl
+       << std::endl;
+}
+
+#endif
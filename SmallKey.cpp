@@ -0,0 +1,73 @@
+#include "SmallKey.h"
+
+#include "Hash.h"
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+const size_t kBlockSize = 64 * 1024;
+}  // namespace
+
+StringArena::StringArena() {}
+
+StringArena::~StringArena() {
+    for (size_t i = 0; i < blocks.size(); i++) {
+        delete[] blocks[i];
+    }
+}
+
+const char* StringArena::store(const char* s, size_t len) {
+    // start a new block when the key does not fit, never grow one in place
+    if (blocks.empty() || cap - used < len) {
+        cap = max(kBlockSize, len);
+        blocks.push_back(new char[cap]);
+        used = 0;
+    }
+    char* dest = blocks.back() + used;
+    memcpy(dest, s, len);
+    used += len;
+    total += len;
+    return dest;
+}
+
+const char* StringArena::intern(const char* s, size_t len) {
+    if (2 * (interned + 1) > index.size()) {
+        growIndex();
+    }
+    size_t mask = index.size() - 1;
+    size_t i = hashBytes(s, len) & mask;
+    while (index[i] != nullptr) {
+        if (lens[i] == len && memcmp(index[i], s, len) == 0) {
+            return index[i];
+        }
+        i = (i + 1) & mask;
+    }
+    index[i] = store(s, len);
+    lens[i] = (uint32_t)len;
+    interned += 1;
+    return index[i];
+}
+
+void StringArena::growIndex() {
+    vector<const char*> oldIndex(max((size_t)64, 2 * index.size()), nullptr);
+    vector<uint32_t> oldLens(oldIndex.size(), 0);
+    oldIndex.swap(index);
+    oldLens.swap(lens);
+
+    size_t mask = index.size() - 1;
+    for (size_t j = 0; j < oldIndex.size(); j++) {
+        if (oldIndex[j] != nullptr) {
+            size_t i = hashBytes(oldIndex[j], oldLens[j]) & mask;
+            while (index[i] != nullptr) {
+                i = (i + 1) & mask;
+            }
+            index[i] = oldIndex[j];
+            lens[i] = oldLens[j];
+        }
+    }
+}
+
+size_t StringArena::bytes() const {
+    return total;
+}
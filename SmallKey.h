@@ -0,0 +1,216 @@
+#ifndef SMALLKEY_H
+#define SMALLKEY_H
+
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * An append-only store for the bytes of keys that are too long to be kept
+ * inline. Blocks are never moved or freed before the arena itself, so a
+ * pointer handed out by store() or intern() stays valid for the arena's
+ * lifetime. intern() stores each distinct string once, so tables and trees
+ * sharing an arena share the bytes of their long keys too.
+ */
+class StringArena {
+public:
+    StringArena();
+    ~StringArena();
+    const char* store(const char* s, size_t len);
+    const char* intern(const char* s, size_t len);
+    size_t bytes() const;
+
+private:
+    StringArena(const StringArena&);             // not copyable, keys point into it
+    StringArena& operator=(const StringArena&);
+    void growIndex();
+
+    std::vector<char*> blocks;  // every block allocated so far
+    size_t used = 0;            // bytes used in the last block
+    size_t cap = 0;             // capacity of the last block
+    size_t total = 0;           // bytes handed out
+
+    // open addressing set of interned strings, power of two sized
+    std::vector<const char*> index;
+    std::vector<uint32_t> lens;
+    size_t interned = 0;
+};
+
+/**
+ * A fixed 16 byte string key. Keys of up to 15 bytes are stored inline,
+ * zero padded, with the length in the last byte. Longer keys keep a pointer
+ * into a StringArena and their length, with 0xFF in the last byte.
+ *
+ * Equal inline keys have equal words, and the byte order of the words gives
+ * the same ordering as std::string, so inline keys compare with two 8 byte
+ * word compares.
+ */
+class SmallKey {
+public:
+    static const size_t kInline = 15;
+
+    SmallKey();
+    SmallKey(const std::string& s, StringArena& arena);
+    SmallKey(const char* s, size_t len, StringArena& arena);
+    static SmallKey view(const char* s, size_t len);  // long keys are not copied
+    static SmallKey view(const std::string& s);
+
+    bool isInline() const;
+    size_t size() const;
+    const char* data() const;
+    std::string str() const;
+
+    bool operator==(const SmallKey& o) const;
+    bool operator!=(const SmallKey& o) const;
+    bool operator<(const SmallKey& o) const;
+    bool operator>(const SmallKey& o) const;
+
+private:
+    void init(const char* s, size_t len, const char* stored);
+    static uint64_t bigEndian(uint64_t w);
+    unsigned char tag() const;
+
+    uint64_t w_[2];
+};
+
+/*
+  ------------------------------------------
+  Begin implementations for the SmallKey class.
+  ------------------------------------------
+*/
+
+inline SmallKey::SmallKey() : w_{0, 0} {}
+
+inline SmallKey::SmallKey(const std::string& s, StringArena& arena) {
+    init(s.data(), s.size(), s.size() > kInline ? arena.intern(s.data(), s.size()) : nullptr);
+}
+
+inline SmallKey::SmallKey(const char* s, size_t len, StringArena& arena) {
+    init(s, len, len > kInline ? arena.intern(s, len) : nullptr);
+}
+
+/**
+ * Builds a key for lookups only. A long key points straight at s, so the
+ * result must not outlive it.
+ */
+inline SmallKey SmallKey::view(const char* s, size_t len) {
+    SmallKey k;
+    k.init(s, len, s);
+    return k;
+}
+
+inline SmallKey SmallKey::view(const std::string& s) {
+    return view(s.data(), s.size());
+}
+
+inline void SmallKey::init(const char* s, size_t len, const char* stored) {
+    w_[0] = 0;
+    w_[1] = 0;
+    char* b = reinterpret_cast<char*>(w_);
+    if (len <= kInline) {
+        memcpy(b, s, len);
+        b[15] = (char)len;
+    } else {
+        uint32_t l = (uint32_t)len;
+        memcpy(b, &stored, sizeof(stored));
+        memcpy(b + 8, &l, sizeof(l));
+        b[15] = (char)0xFF;
+    }
+}
+
+inline unsigned char SmallKey::tag() const {
+    return reinterpret_cast<const unsigned char*>(w_)[15];
+}
+
+inline bool SmallKey::isInline() const {
+    return tag() != 0xFF;
+}
+
+inline size_t SmallKey::size() const {
+    if (isInline()) {
+        return tag();
+    }
+    uint32_t l;
+    memcpy(&l, reinterpret_cast<const char*>(w_) + 8, sizeof(l));
+    return l;
+}
+
+inline const char* SmallKey::data() const {
+    if (isInline()) {
+        return reinterpret_cast<const char*>(w_);
+    }
+    const char* p;
+    memcpy(&p, w_, sizeof(p));
+    return p;
+}
+
+inline std::string SmallKey::str() const {
+    return std::string(data(), size());
+}
+
+inline uint64_t SmallKey::bigEndian(uint64_t w) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    return __builtin_bswap64(w);
+#else
+    return w;
+#endif
+}
+
+inline bool SmallKey::operator==(const SmallKey& o) const {
+    if (w_[0] == o.w_[0] && w_[1] == o.w_[1]) {
+        return true;
+    }
+    // long keys from different arenas, or lookup views, may still hold the same bytes
+    if (isInline() || o.isInline()) {
+        return false;
+    }
+    size_t len = size();
+    return len == o.size() && memcmp(data(), o.data(), len) == 0;
+}
+
+inline bool SmallKey::operator!=(const SmallKey& o) const {
+    return !(*this == o);
+}
+
+inline bool SmallKey::operator<(const SmallKey& o) const {
+    if (isInline() && o.isInline()) {
+        uint64_t a = bigEndian(w_[0]);
+        uint64_t b = bigEndian(o.w_[0]);
+        if (a != b) {
+            return a < b;
+        }
+        return bigEndian(w_[1]) < bigEndian(o.w_[1]);
+    }
+    size_t l1 = size();
+    size_t l2 = o.size();
+    int c = memcmp(data(), o.data(), l1 < l2 ? l1 : l2);
+    return c < 0 || (c == 0 && l1 < l2);
+}
+
+inline bool SmallKey::operator>(const SmallKey& o) const {
+    return o < *this;
+}
+
+inline std::ostream& operator<<(std::ostream& os, const SmallKey& k) {
+    return os.write(k.data(), k.size());
+}
+
+// lets BinarySearchTree::prefix_scan() run on SmallKey keys
+inline bool keyHasPrefix(const SmallKey& k, const SmallKey& prefix) {
+    return k.size() >= prefix.size() && memcmp(k.data(), prefix.data(), prefix.size()) == 0;
+}
+
+// lets freeze() in FrozenTree.h take the bytes of SmallKey keys
+inline std::string keyString(const SmallKey& k) {
+    return k.str();
+}
+
+/*
+  ----------------------------------------
+  End implementations for the SmallKey class.
+  ----------------------------------------
+*/
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef SPSCRING_H
+#define SPSCRING_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+/**
+ * A bounded lock-free queue for exactly one producer thread and one
+ * consumer thread. push() and pop() never block; they return false when
+ * the ring is full or empty and the caller decides how to wait.
+ */
+template<typename T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t capacity);
+
+    bool push(const T& item);  // producer only
+    bool pop(T& item);         // consumer only
+    size_t size() const;       // exact only when called by the producer or consumer
+    size_t capacity() const;
+
+private:
+    SpscRing(const SpscRing&);
+    SpscRing& operator=(const SpscRing&);
+
+    std::vector<T> buf;
+    size_t mask;
+    // head and tail on their own cache lines so the two threads do not share one
+    alignas(64) std::atomic<size_t> head;  // next slot to pop, written by the consumer
+    alignas(64) std::atomic<size_t> tail;  // next slot to push, written by the producer
+};
+
+/**
+ * Rounds capacity up to a power of two so positions wrap with a mask.
+ */
+template<typename T>
+SpscRing<T>::SpscRing(size_t capacity) : head(0), tail(0) {
+    size_t cap = 1;
+    while (cap < capacity) {
+        cap <<= 1;
+    }
+    buf.resize(cap);
+    mask = cap - 1;
+}
+
+template<typename T>
+bool SpscRing<T>::push(const T& item) {
+    size_t t = tail.load(std::memory_order_relaxed);
+    if (t - head.load(std::memory_order_acquire) == buf.size()) {
+        return false;  // full
+    }
+    buf[t & mask] = item;
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+}
+
+template<typename T>
+bool SpscRing<T>::pop(T& item) {
+    size_t h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire)) {
+        return false;  // empty
+    }
+    item = buf[h & mask];
+    head.store(h + 1, std::memory_order_release);
+    return true;
+}
+
+template<typename T>
+size_t SpscRing<T>::size() const {
+    return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+}
+
+template<typename T>
+size_t SpscRing<T>::capacity() const {
+    return buf.size();
+}
+
+#endif
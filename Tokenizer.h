@@ -0,0 +1,53 @@
+#ifndef TOKENIZER_H
+#define TOKENIZER_H
+
+#include <cctype>
+#include <string>
+
+/**
+ * Splits a stream of bytes into words the same way counting.cpp's
+ * process() does: whitespace separates words, letters are lowercased and
+ * every other byte is dropped. Input can arrive in blocks of any size; a
+ * word cut by a block boundary is carried over to the next feed().
+ */
+class Tokenizer {
+public:
+    template<typename Emit>
+    void feed(const char* buf, size_t len, Emit emit);
+    template<typename Emit>
+    void finish(Emit emit);
+
+private:
+    std::string word;  // the word in progress, may span blocks
+};
+
+/**
+ * Calls emit(const std::string&) for every word completed in buf.
+ */
+template<typename Emit>
+void Tokenizer::feed(const char* buf, size_t len, Emit emit) {
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)buf[i];
+        if (isspace(c)) {
+            if (!word.empty()) {
+                emit(word);
+                word.clear();
+            }
+        } else if (isalpha(c)) {
+            word += (char)tolower(c);
+        }
+    }
+}
+
+/**
+ * Emits the last word once the input has ended.
+ */
+template<typename Emit>
+void Tokenizer::finish(Emit emit) {
+    if (!word.empty()) {
+        emit(word);
+        word.clear();
+    }
+}
+
+#endif
@@ -3,9 +3,14 @@
 
 #include "bst.h"
 #include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <cstdlib>
 #include <exception>
 #include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 struct KeyError {};
 
@@ -25,6 +30,10 @@ public:
     int getHeight() const;
     void setHeight(int height);
 
+    // Getter/setter for the number of nodes in this subtree, kept only by order-statistic trees.
+    int getSize() const;
+    void setSize(int size);
+
     // Getters for parent, left, and right. These need to be redefined since they
     // return pointers to AVLNodes - not plain Nodes. See the Node class in bst.h
     // for more information.
@@ -34,6 +43,7 @@ public:
 
 protected:
     int height_;
+    int size_;
 };
 
 /*
@@ -48,7 +58,7 @@ protected:
  */
 template<class Key, class Value>
 AVLNode<Key, Value>::AVLNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent)
-        : Node<Key, Value>(key, value, parent), height_(1) {}
+        : Node<Key, Value>(key, value, parent), height_(1), size_(1) {}
 
 /**
  * A destructor which does nothing.
@@ -72,6 +82,22 @@ void AVLNode<Key, Value>::setHeight(int height) {
     height_ = height;
 }
 
+/**
+ * A getter for the subtree size of a AVLNode.
+ */
+template<class Key, class Value>
+int AVLNode<Key, Value>::getSize() const {
+    return size_;
+}
+
+/**
+ * A setter for the subtree size of a AVLNode.
+ */
+template<class Key, class Value>
+void AVLNode<Key, Value>::setSize(int size) {
+    size_ = size;
+}
+
 /**
  * An overridden function for getting the parent since a static_cast is necessary to make sure
  * that our node is a AVLNode.
@@ -103,12 +129,28 @@ AVLNode<Key, Value>* AVLNode<Key, Value>::getRight() const {
   -----------------------------------------------
 */
 
+/**
+ * An AVL tree. Constructed with orderStats, every node also keeps the size
+ * of its subtree, so rank() and select() take O(log n) instead of a walk.
+ */
 template<class Key, class Value>
 class AVLTree : public BinarySearchTree<Key, Value> {
 public:
+    AVLTree(bool orderStats = false);
     virtual void insert(const std::pair<const Key, Value>& new_item);  // TODO
     virtual void remove(const Key& key);                               // TODO
-        
+    int rank(const Key& key) const;  // number of keys less than key
+    typename BinarySearchTree<Key, Value>::iterator select(int k) const;  // the k-th smallest item, from 0
+    bool checkHeights() const;  // O(n), O(1) memory check of the stored heights
+    void split(const Key& key, AVLTree& upper);  // moves the keys not less than key into upper
+    void join(AVLTree& upper);                   // moves all of upper, whose keys are all greater, into this
+    template<typename F>
+    void parallelInOrder(size_t runs, unsigned int threads, F f) const;
+    template<typename It>
+    void insert_bulk(It first, It last, unsigned int threads = 0);  // adds the values of repeated keys
+    template<typename It, typename MakeKey>
+    void insert_bulk(It first, It last, unsigned int threads, MakeKey makeKey);  // new nodes store makeKey(key)
+
 protected:
     virtual void nodeSwap(AVLNode<Key, Value>* n1, AVLNode<Key, Value>* n2);
 
@@ -122,10 +164,35 @@ protected:
     bool rightChildExists(AVLNode<Key, Value>* n);
     bool leftChildExists(AVLNode<Key, Value>* n);
     void updateHeight(AVLNode<Key, Value>* n);
+    void addToSizes(AVLNode<Key, Value>* n, int delta);
+    static int sizeOf(AVLNode<Key, Value>* n);
+    static int heightOf(AVLNode<Key, Value>* n);
+    AVLNode<Key, Value>* liftChild(AVLNode<Key, Value>* c);
+    AVLNode<Key, Value>* rebalanceFrom(AVLNode<Key, Value>* x);
+    AVLNode<Key, Value>* joinTrees(AVLNode<Key, Value>* l, AVLNode<Key, Value>* m, AVLNode<Key, Value>* r);
+    void splitAt(AVLNode<Key, Value>* t, const Key& key, AVLNode<Key, Value>*& lo, AVLNode<Key, Value>*& hi);
+    AVLNode<Key, Value>* detachMin(AVLNode<Key, Value>* t, AVLNode<Key, Value>*& min);
+    static void detach(AVLNode<Key, Value>* t, AVLNode<Key, Value>*& l, AVLNode<Key, Value>*& r);
+    template<typename MakeKey>
+    AVLNode<Key, Value>*
+    buildBalanced(const std::vector<std::pair<Key, Value> >& items, size_t lo, size_t hi, MakeKey& makeKey);
+    template<typename MakeKey>
+    AVLNode<Key, Value>* unionSorted(
+            AVLNode<Key, Value>* t,
+            const std::vector<std::pair<Key, Value> >& items,
+            size_t lo,
+            size_t hi,
+            int forks,
+            MakeKey& makeKey);
+
+    bool orderStats_;  // subtree sizes are maintained
 
     using iter_type = typename BinarySearchTree<Key, Value>::iterator;
 };
 
+template<class Key, class Value>
+AVLTree<Key, Value>::AVLTree(bool orderStats) : orderStats_(orderStats) {}
+
 template<class Key, class Value>
 void AVLTree<Key, Value>::insert(const std::pair<const Key, Value>& new_item) {
     // TODO
@@ -171,6 +238,9 @@ void AVLTree<Key, Value>::insert(const std::pair<const Key, Value>& new_item) {
     } else
         x->setRight(n);
 
+    // count n above it before any rotation recomputes sizes from children
+    addToSizes(x, 1);
+
     // checking height above n
     if (x->getHeight() == 1) {
         x->setHeight(x->getHeight() + 1);  // update parent's height
@@ -347,6 +417,7 @@ void AVLTree<Key, Value>::remove(const Key& key) {
     }
     p = r->getParent();
     delete r;
+    addToSizes(p, -1);
     removeFix(p);
 }
 
@@ -502,6 +573,89 @@ void AVLTree<Key, Value>::updateHeight(AVLNode<Key, Value>* n) {
     } else {
         n->setHeight(1);
     }
+
+    // called bottom up after every rotation, so the children's sizes are current
+    if (orderStats_) {
+        n->setSize(sizeOf(n->getLeft()) + sizeOf(n->getRight()) + 1);
+    }
+}
+
+/**
+ * Adds delta to the subtree size of n and of every node above it.
+ */
+template<class Key, class Value>
+void AVLTree<Key, Value>::addToSizes(AVLNode<Key, Value>* n, int delta) {
+    if (!orderStats_) {
+        return;
+    }
+    for (; n != NULL; n = n->getParent()) {
+        n->setSize(n->getSize() + delta);
+    }
+}
+
+template<class Key, class Value>
+int AVLTree<Key, Value>::sizeOf(AVLNode<Key, Value>* n) {
+    return n == NULL ? 0 : n->getSize();
+}
+
+/**
+ * Returns how many keys in the tree are less than key, whether or not key
+ * is in the tree. Without orderStats this walks the tree from begin().
+ */
+template<class Key, class Value>
+int AVLTree<Key, Value>::rank(const Key& key) const {
+    int r = 0;
+    if (!orderStats_) {
+        for (iter_type it = this->begin(); it != this->end() && it->first < key; ++it) {
+            r++;
+        }
+        return r;
+    }
+
+    // everything left of where the descent turns right is smaller
+    AVLNode<Key, Value>* x = static_cast<AVLNode<Key, Value>*>(this->root_);
+    while (x != NULL) {
+        if (x->getKey() < key) {
+            r += sizeOf(x->getLeft()) + 1;
+            x = x->getRight();
+        } else {
+            x = x->getLeft();
+        }
+    }
+    return r;
+}
+
+/**
+ * Returns an iterator to the item with k smaller keys before it, or the end
+ * iterator if the tree has k items or fewer. Without orderStats this walks
+ * the tree from begin().
+ */
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator AVLTree<Key, Value>::select(int k) const {
+    if (k < 0) {
+        return this->end();
+    }
+    if (!orderStats_) {
+        iter_type it = this->begin();
+        for (; it != this->end() && k > 0; k--) {
+            ++it;
+        }
+        return it;
+    }
+
+    AVLNode<Key, Value>* x = static_cast<AVLNode<Key, Value>*>(this->root_);
+    while (x != NULL) {
+        int left = sizeOf(x->getLeft());
+        if (k < left) {
+            x = x->getLeft();
+        } else if (k == left) {
+            break;
+        } else {
+            k -= left + 1;
+            x = x->getRight();
+        }
+    }
+    return this->iteratorAt(x);
 }
 
 template<class Key, class Value>
@@ -568,6 +722,26 @@ void AVLTree<Key, Value>::rotateRight(AVLNode<Key, Value>* g, AVLNode<Key, Value
     }
 }
 
+/**
+ * A cheaper isBalanced() that trusts the stored heights instead of
+ * recomputing them: every node's height must be one more than its taller
+ * child's, and its children's heights may differ by at most one. Each node
+ * is checked against its children only, in one in-order walk over the
+ * parent pointers, so it needs no stack and no extra memory.
+ */
+template<class Key, class Value>
+bool AVLTree<Key, Value>::checkHeights() const {
+    for (Node<Key, Value>* x = this->getSmallestNode(); x != NULL; x = this->successor(x)) {
+        AVLNode<Key, Value>* n = static_cast<AVLNode<Key, Value>*>(x);
+        int l = n->getLeft() == NULL ? 0 : n->getLeft()->getHeight();
+        int r = n->getRight() == NULL ? 0 : n->getRight()->getHeight();
+        if (n->getHeight() != std::max(l, r) + 1 || std::abs(l - r) > 1) {
+            return false;
+        }
+    }
+    return true;
+}
+
 template<class Key, class Value>
 bool AVLTree<Key, Value>::isLeftChild(AVLNode<Key, Value>* n, AVLNode<Key, Value>* p) {
     return p->getLeft() == n;
@@ -594,6 +768,495 @@ void AVLTree<Key, Value>::nodeSwap(AVLNode<Key, Value>* n1, AVLNode<Key, Value>*
     int tempH = n1->getHeight();
     n1->setHeight(n2->getHeight());
     n2->setHeight(tempH);
+
+    // sizes, like heights, belong to the position in the tree
+    int tempS = n1->getSize();
+    n1->setSize(n2->getSize());
+    n2->setSize(tempS);
+}
+
+/**
+ * Moves every item whose key is not less than key into upper, keeping the
+ * smaller ones; upper's own items are cleared first. Takes O(log n): the
+ * path to key is cut, and the subtrees hanging off it are joined into the
+ * two results. Both trees should share the orderStats setting.
+ */
+template<class Key, class Value>
+void AVLTree<Key, Value>::split(const Key& key, AVLTree& upper) {
+    if (&upper == this) {
+        return;
+    }
+    upper.clear();
+    AVLNode<Key, Value>* lo = NULL;
+    AVLNode<Key, Value>* hi = NULL;
+    splitAt(static_cast<AVLNode<Key, Value>*>(this->root_), key, lo, hi);
+    this->root_ = lo;
+    upper.root_ = hi;
+}
+
+/**
+ * Moves every item of upper into this tree, leaving upper empty. Every key
+ * in upper must be greater than every key here. Takes O(log n): upper's
+ * smallest node is cut out and becomes the join point of the two trees.
+ */
+template<class Key, class Value>
+void AVLTree<Key, Value>::join(AVLTree& upper) {
+    if (&upper == this || upper.root_ == NULL) {
+        return;
+    }
+    AVLNode<Key, Value>* min = NULL;
+    AVLNode<Key, Value>* rest = detachMin(static_cast<AVLNode<Key, Value>*>(upper.root_), min);
+    upper.root_ = NULL;
+    this->root_ = joinTrees(static_cast<AVLNode<Key, Value>*>(this->root_), min, rest);
+}
+
+/**
+ * Cuts t off from its children, which become roots of their own.
+ */
+template<class Key, class Value>
+void AVLTree<Key, Value>::detach(AVLNode<Key, Value>* t, AVLNode<Key, Value>*& l, AVLNode<Key, Value>*& r) {
+    l = t->getLeft();
+    r = t->getRight();
+    if (l != NULL) {
+        l->setParent(NULL);
+    }
+    if (r != NULL) {
+        r->setParent(NULL);
+    }
+    t->setLeft(NULL);
+    t->setRight(NULL);
+    t->setParent(NULL);
+}
+
+template<class Key, class Value>
+void AVLTree<Key, Value>::splitAt(
+        AVLNode<Key, Value>* t, const Key& key, AVLNode<Key, Value>*& lo, AVLNode<Key, Value>*& hi) {
+    if (t == NULL) {
+        lo = NULL;
+        hi = NULL;
+        return;
+    }
+    AVLNode<Key, Value>* l;
+    AVLNode<Key, Value>* r;
+    detach(t, l, r);
+    AVLNode<Key, Value>* a;
+    AVLNode<Key, Value>* b;
+    if (t->getKey() < key) {
+        splitAt(r, key, a, b);
+        lo = joinTrees(l, t, a);
+        hi = b;
+    } else {
+        splitAt(l, key, a, b);
+        lo = a;
+        hi = joinTrees(b, t, r);
+    }
+}
+
+/**
+ * Removes the smallest node of the tree rooted at t, returning it in min
+ * and the root of what is left.
+ */
+template<class Key, class Value>
+AVLNode<Key, Value>* AVLTree<Key, Value>::detachMin(AVLNode<Key, Value>* t, AVLNode<Key, Value>*& min) {
+    AVLNode<Key, Value>* l;
+    AVLNode<Key, Value>* r;
+    detach(t, l, r);
+    if (l == NULL) {
+        min = t;
+        return r;
+    }
+    return joinTrees(detachMin(l, min), t, r);
+}
+
+/**
+ * Joins the trees rooted at l and r, whose keys are all less and all
+ * greater than m's, through the lone node m. The shorter tree and m
+ * replace the subtree of matching height on the taller tree's inner spine,
+ * which is then rebalanced upwards: O(1 + the height difference).
+ */
+template<class Key, class Value>
+AVLNode<Key, Value>*
+AVLTree<Key, Value>::joinTrees(AVLNode<Key, Value>* l, AVLNode<Key, Value>* m, AVLNode<Key, Value>* r) {
+    int hl = heightOf(l);
+    int hr = heightOf(r);
+    AVLNode<Key, Value>* p = NULL;  // where m is hung on the taller tree
+    if (hl > hr + 1) {
+        while (heightOf(l) > hr + 1) {
+            p = l;
+            l = l->getRight();
+        }
+    } else if (hr > hl + 1) {
+        while (heightOf(r) > hl + 1) {
+            p = r;
+            r = r->getLeft();
+        }
+    }
+
+    m->setLeft(l);
+    m->setRight(r);
+    if (l != NULL) {
+        l->setParent(m);
+    }
+    if (r != NULL) {
+        r->setParent(m);
+    }
+    m->setParent(p);
+    updateHeight(m);
+    if (p == NULL) {
+        return m;
+    }
+    if (hl > hr) {
+        p->setRight(m);
+    } else {
+        p->setLeft(m);
+    }
+    return rebalanceFrom(p);
+}
+
+/**
+ * Rotates c above its parent, keeping the grandparent's link, and returns c.
+ */
+template<class Key, class Value>
+AVLNode<Key, Value>* AVLTree<Key, Value>::liftChild(AVLNode<Key, Value>* c) {
+    AVLNode<Key, Value>* g = c->getParent();
+    AVLNode<Key, Value>* top = g->getParent();
+    if (g->getLeft() == c) {
+        g->setLeft(c->getRight());
+        if (c->getRight() != NULL) {
+            c->getRight()->setParent(g);
+        }
+        c->setRight(g);
+    } else {
+        g->setRight(c->getLeft());
+        if (c->getLeft() != NULL) {
+            c->getLeft()->setParent(g);
+        }
+        c->setLeft(g);
+    }
+    g->setParent(c);
+    c->setParent(top);
+    if (top != NULL) {
+        if (top->getLeft() == g) {
+            top->setLeft(c);
+        } else {
+            top->setRight(c);
+        }
+    }
+    updateHeight(g);
+    updateHeight(c);
+    return c;
+}
+
+/**
+ * Updates heights (and sizes) from x up to its root, rotating wherever the
+ * children differ by two, and returns the root.
+ */
+template<class Key, class Value>
+AVLNode<Key, Value>* AVLTree<Key, Value>::rebalanceFrom(AVLNode<Key, Value>* x) {
+    AVLNode<Key, Value>* top = x;
+    while (x != NULL) {
+        updateHeight(x);
+        int diff = heightOf(x->getLeft()) - heightOf(x->getRight());
+        if (diff > 1) {
+            AVLNode<Key, Value>* c = x->getLeft();
+            if (heightOf(c->getLeft()) < heightOf(c->getRight())) {
+                liftChild(c->getRight());  // zig-zag
+            }
+            x = liftChild(x->getLeft());
+        } else if (diff < -1) {
+            AVLNode<Key, Value>* c = x->getRight();
+            if (heightOf(c->getRight()) < heightOf(c->getLeft())) {
+                liftChild(c->getLeft());
+            }
+            x = liftChild(x->getRight());
+        }
+        top = x;
+        x = x->getParent();
+    }
+    return top;
+}
+
+template<class Key, class Value>
+int AVLTree<Key, Value>::heightOf(AVLNode<Key, Value>* n) {
+    return n == NULL ? 0 : n->getHeight();
+}
+
+/**
+ * Calls f(run, item) for every item, with the items cut into at most runs
+ * runs of consecutive keys: every item of run i comes before every item of
+ * run i + 1. Runs are handed out to threads threads (0 means one per
+ * core), and each run is walked in order, so writing run i into buffer i
+ * and concatenating the buffers gives the same output as begin() to end().
+ *
+ * The runs come from the top of the tree: each subtree deep enough to be
+ * under a few runs' worth of items is a unit, and the nodes above them go
+ * with the unit on their left. Units are grouped into runs by estimated
+ * size, from the subtree sizes when orderStats is on, else 2^height.
+ */
+template<class Key, class Value>
+template<typename F>
+void AVLTree<Key, Value>::parallelInOrder(size_t runs, unsigned int threads, F f) const {
+    if (this->root_ == NULL) {
+        return;
+    }
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    runs = std::max(runs, (size_t)1);
+
+    struct Unit {
+        AVLNode<Key, Value>* n;
+        bool whole;     // the whole subtree under n, else just n
+        double weight;  // estimated items
+    };
+    AVLNode<Key, Value>* root = static_cast<AVLNode<Key, Value>*>(this->root_);
+    double total = orderStats_ ? root->getSize() : std::ldexp(1.0, root->getHeight());
+    double unitTarget = total / (4 * runs);
+
+    // in-order list of units, splitting subtrees bigger than unitTarget
+    std::vector<Unit> units;
+    std::vector<std::pair<AVLNode<Key, Value>*, bool> > todo;  // node, already split
+    todo.push_back(std::make_pair(root, false));
+    while (!todo.empty()) {
+        AVLNode<Key, Value>* n = todo.back().first;
+        bool expanded = todo.back().second;
+        todo.pop_back();
+        if (n == NULL) {
+            continue;
+        }
+        double weight = orderStats_ ? n->getSize() : std::ldexp(1.0, n->getHeight());
+        if (expanded) {
+            Unit u = {n, false, 1};
+            units.push_back(u);
+        } else if (weight <= unitTarget || n->getHeight() <= 2) {
+            Unit u = {n, true, weight};
+            units.push_back(u);
+        } else {
+            todo.push_back(std::make_pair(n->getRight(), false));
+            todo.push_back(std::make_pair(n, true));
+            todo.push_back(std::make_pair(n->getLeft(), false));
+        }
+    }
+
+    // consecutive units make up each run
+    std::vector<size_t> firstUnit(1, 0);
+    double acc = 0;
+    double sum = 0;
+    for (size_t i = 0; i < units.size(); i++) {
+        sum += units[i].weight;
+    }
+    for (size_t i = 0; i < units.size(); i++) {
+        acc += units[i].weight;
+        if (acc >= sum * firstUnit.size() / runs && firstUnit.size() < runs && i + 1 < units.size()) {
+            firstUnit.push_back(i + 1);
+        }
+    }
+    firstUnit.push_back(units.size());
+
+    std::atomic<size_t> next(0);
+    size_t numRuns = firstUnit.size() - 1;
+    auto work = [&]() {
+        std::vector<AVLNode<Key, Value>*> path;
+        for (size_t run = next++; run < numRuns; run = next++) {
+            for (size_t i = firstUnit[run]; i < firstUnit[run + 1]; i++) {
+                if (!units[i].whole) {
+                    f(run, units[i].n->getItem());
+                    continue;
+                }
+                AVLNode<Key, Value>* n = units[i].n;
+                while (n != NULL || !path.empty()) {
+                    while (n != NULL) {
+                        path.push_back(n);
+                        n = n->getLeft();
+                    }
+                    n = path.back();
+                    path.pop_back();
+                    f(run, n->getItem());
+                    n = n->getRight();
+                }
+            }
+        }
+    };
+    std::vector<std::thread> pool;
+    for (unsigned int t = 1; t < threads; t++) {
+        pool.push_back(std::thread(work));
+    }
+    work();
+    for (size_t t = 0; t < pool.size(); t++) {
+        pool[t].join();
+    }
+}
+
+/**
+ * Inserts every item of [first, last), adding together the values of
+ * repeated keys, including keys already in the tree. The batch is sorted
+ * and its duplicates summed before it touches the tree: chunks are sorted
+ * on threads threads (0 means one per core) and merged pairwise in
+ * parallel. The sorted batch is then united with this tree by splitting
+ * and joining, O(m log(n / m + 1)), with the top levels of the union
+ * forked onto threads too.
+ */
+template<class Key, class Value>
+template<typename It>
+void AVLTree<Key, Value>::insert_bulk(It first, It last, unsigned int threads) {
+    insert_bulk(first, last, threads, [](const Key& key) { return key; });
+}
+
+/**
+ * As above, but a key that is not in the tree yet is stored as
+ * makeKey(key), so the batch can hold cheap keys (views, say) that are
+ * turned into owning ones only for the nodes actually created. makeKey is
+ * called under a lock, one key at a time.
+ */
+template<class Key, class Value>
+template<typename It, typename MakeKey>
+void AVLTree<Key, Value>::insert_bulk(It first, It last, unsigned int threads, MakeKey makeKey) {
+    std::vector<std::pair<Key, Value> > items(first, last);
+    if (items.empty()) {
+        return;
+    }
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    const size_t kMinChunk = 1 << 14;  // smaller chunks are not worth a thread
+    size_t chunks = std::max((size_t)1, std::min((size_t)threads, items.size() / kMinChunk));
+    auto byKey = [](const std::pair<Key, Value>& x, const std::pair<Key, Value>& y) { return x.first < y.first; };
+
+    // sort chunks side by side, then merge neighbours until one run is left
+    std::vector<size_t> bounds;
+    for (size_t c = 0; c <= chunks; c++) {
+        bounds.push_back(items.size() * c / chunks);
+    }
+    std::vector<std::thread> pool;
+    for (size_t c = 0; c < chunks; c++) {
+        pool.push_back(std::thread(
+                [&, c]() { std::sort(items.begin() + bounds[c], items.begin() + bounds[c + 1], byKey); }));
+    }
+    for (size_t c = 0; c < pool.size(); c++) {
+        pool[c].join();
+    }
+    while (bounds.size() > 2) {
+        std::vector<size_t> merged;
+        pool.clear();
+        for (size_t c = 0; c + 2 < bounds.size(); c += 2) {
+            merged.push_back(bounds[c]);
+            pool.push_back(std::thread([&, c]() {
+                std::inplace_merge(
+                        items.begin() + bounds[c], items.begin() + bounds[c + 1], items.begin() + bounds[c + 2], byKey);
+            }));
+        }
+        if (bounds.size() % 2 == 0) {
+            merged.push_back(bounds[bounds.size() - 2]);  // an odd run out waits for the next round
+        }
+        merged.push_back(bounds.back());
+        for (size_t c = 0; c < pool.size(); c++) {
+            pool[c].join();
+        }
+        bounds.swap(merged);
+    }
+
+    // duplicates are next to each other now
+    size_t out = 0;
+    for (size_t i = 1; i < items.size(); i++) {
+        if (items[i].first == items[out].first) {
+            items[out].second = items[out].second + items[i].second;
+        } else if (++out != i) {
+            items[out] = items[i];
+        }
+    }
+    items.resize(out + 1);
+
+    int forks = 0;  // levels of the union that fork a thread
+    while ((1u << forks) < threads) {
+        forks++;
+    }
+    std::mutex keyLock;
+    auto lockedKey = [&](const Key& key) -> Key {
+        std::lock_guard<std::mutex> hold(keyLock);
+        return makeKey(key);
+    };
+    this->root_ = unionSorted(static_cast<AVLNode<Key, Value>*>(this->root_), items, 0, items.size(), forks, lockedKey);
+}
+
+/**
+ * Builds a perfectly balanced tree of items[lo, hi), which are sorted and
+ * distinct, and returns its root.
+ */
+template<class Key, class Value>
+template<typename MakeKey>
+AVLNode<Key, Value>* AVLTree<Key, Value>::buildBalanced(
+        const std::vector<std::pair<Key, Value> >& items, size_t lo, size_t hi, MakeKey& makeKey) {
+    if (lo == hi) {
+        return NULL;
+    }
+    size_t mid = lo + (hi - lo) / 2;
+    AVLNode<Key, Value>* n = new AVLNode<Key, Value>(makeKey(items[mid].first), items[mid].second, NULL);
+    AVLNode<Key, Value>* l = buildBalanced(items, lo, mid, makeKey);
+    AVLNode<Key, Value>* r = buildBalanced(items, mid + 1, hi, makeKey);
+    n->setLeft(l);
+    n->setRight(r);
+    if (l != NULL) {
+        l->setParent(n);
+    }
+    if (r != NULL) {
+        r->setParent(n);
+    }
+    updateHeight(n);
+    return n;
+}
+
+/**
+ * Unites the tree rooted at t with items[lo, hi), sorted and distinct,
+ * adding the values of keys in both. The middle item splits t, the halves
+ * are united with the items either side of it, and the two results are
+ * joined through t's node for that key if it had one, or a new node if
+ * not. The first forks levels unite the left halves on a new thread; the
+ * subtrees and item ranges involved are disjoint.
+ */
+template<class Key, class Value>
+template<typename MakeKey>
+AVLNode<Key, Value>* AVLTree<Key, Value>::unionSorted(
+        AVLNode<Key, Value>* t,
+        const std::vector<std::pair<Key, Value> >& items,
+        size_t lo,
+        size_t hi,
+        int forks,
+        MakeKey& makeKey) {
+    if (lo == hi) {
+        return t;
+    }
+    if (t == NULL) {
+        return buildBalanced(items, lo, hi, makeKey);
+    }
+    size_t mid = lo + (hi - lo) / 2;
+    AVLNode<Key, Value>* less;
+    AVLNode<Key, Value>* rest;
+    splitAt(t, items[mid].first, less, rest);
+
+    // rest starts with the middle key if t had it
+    AVLNode<Key, Value>* first = rest;
+    while (first != NULL && first->getLeft() != NULL) {
+        first = first->getLeft();
+    }
+    AVLNode<Key, Value>* m;
+    if (first != NULL && first->getKey() == items[mid].first) {
+        rest = detachMin(rest, m);
+        m->setValue(m->getValue() + items[mid].second);
+    } else {
+        m = new AVLNode<Key, Value>(makeKey(items[mid].first), items[mid].second, NULL);
+    }
+
+    AVLNode<Key, Value>* l;
+    AVLNode<Key, Value>* r;
+    if (forks > 0) {
+        std::thread left([&]() { l = unionSorted(less, items, lo, mid, forks - 1, makeKey); });
+        r = unionSorted(rest, items, mid + 1, hi, forks - 1, makeKey);
+        left.join();
+    } else {
+        l = unionSorted(less, items, lo, mid, 0, makeKey);
+        r = unionSorted(rest, items, mid + 1, hi, 0, makeKey);
+    }
+    return joinTrees(l, m, r);
 }
 
 #endif
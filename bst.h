@@ -5,7 +5,17 @@
 #include <cstdlib>
 #include <exception>
 #include <iostream>
+#include <string>
 #include <utility>
+#include <vector>
+
+/**
+ * True iff k starts with prefix. BinarySearchTree::prefix_scan() calls this
+ * unqualified, so other key types can add an overload next to their class.
+ */
+inline bool keyHasPrefix(const std::string& k, const std::string& prefix) {
+    return k.compare(0, prefix.size(), prefix) == 0;
+}
 
 /**
  * A templated class for a Node in a search tree.
@@ -207,6 +217,10 @@ public:
     iterator begin() const;
     iterator end() const;
     iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;  // first item whose key is not less than key
+    iterator upper_bound(const Key& key) const;  // first item whose key is greater than key
+    std::pair<iterator, iterator> equal_range(const Key& key) const;
+    std::pair<iterator, iterator> prefix_scan(const Key& prefix) const;  // items whose key starts with prefix
 
 protected:
     // Mandatory helper functions
@@ -221,7 +235,8 @@ protected:
     virtual void nodeSwap(Node<Key, Value>* n1, Node<Key, Value>* n2);
 
     // Add helper functions here
-    Node<Key, Value>* successor(Node<Key, Value>* current);
+    static iterator iteratorAt(Node<Key, Value>* n);  // lets derived trees hand out iterators
+    static Node<Key, Value>* successor(Node<Key, Value>* current);
     int balHelper(Node<Key, Value>* n) const;
     void clearHelper(Node<Key, Value>* n);
 
@@ -382,6 +397,81 @@ typename BinarySearchTree<Key, Value>::iterator BinarySearchTree<Key, Value>::fi
     return it;
 }
 
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator BinarySearchTree<Key, Value>::iteratorAt(Node<Key, Value>* n) {
+    return iterator(n);
+}
+
+/**
+ * Returns an iterator to the first item whose key is not less than k, or
+ * the end iterator if there is none. One descent from the root.
+ */
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator BinarySearchTree<Key, Value>::lower_bound(const Key& k) const {
+    Node<Key, Value>* best = NULL;
+    Node<Key, Value>* x = root_;
+    while (x != NULL) {
+        if (x->getKey() < k) {
+            x = x->getRight();
+        } else {
+            best = x;  // a candidate, anything smaller that qualifies is on the left
+            x = x->getLeft();
+        }
+    }
+    return iterator(best);
+}
+
+/**
+ * Returns an iterator to the first item whose key is greater than k, or
+ * the end iterator if there is none.
+ */
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator BinarySearchTree<Key, Value>::upper_bound(const Key& k) const {
+    Node<Key, Value>* best = NULL;
+    Node<Key, Value>* x = root_;
+    while (x != NULL) {
+        if (k < x->getKey()) {
+            best = x;
+            x = x->getLeft();
+        } else {
+            x = x->getRight();
+        }
+    }
+    return iterator(best);
+}
+
+/**
+ * Returns the range of items with key k: empty, or the one item since keys
+ * are unique.
+ */
+template<class Key, class Value>
+std::pair<typename BinarySearchTree<Key, Value>::iterator, typename BinarySearchTree<Key, Value>::iterator>
+BinarySearchTree<Key, Value>::equal_range(const Key& k) const {
+    return std::make_pair(lower_bound(k), upper_bound(k));
+}
+
+/**
+ * Returns the range of items whose key starts with prefix. Those keys sort
+ * together right after prefix, so the range runs from lower_bound(prefix)
+ * to the first key past prefix that does not start with it, and both ends
+ * are found with one descent each. Needs keyHasPrefix() for the key type.
+ */
+template<class Key, class Value>
+std::pair<typename BinarySearchTree<Key, Value>::iterator, typename BinarySearchTree<Key, Value>::iterator>
+BinarySearchTree<Key, Value>::prefix_scan(const Key& prefix) const {
+    Node<Key, Value>* best = NULL;
+    Node<Key, Value>* x = root_;
+    while (x != NULL) {
+        if (x->getKey() < prefix || keyHasPrefix(x->getKey(), prefix)) {
+            x = x->getRight();
+        } else {
+            best = x;
+            x = x->getLeft();
+        }
+    }
+    return std::make_pair(lower_bound(prefix), iterator(best));
+}
+
 /**
  * An insert method to insert into a Binary Search Tree.
  * The tree will not remain balanced when inserting.
@@ -569,6 +659,32 @@ Node<Key, Value>* BinarySearchTree<Key, Value>::predecessor(Node<Key, Value>* cu
     return current;
 }
 
+/**
+ * Returns the next node in order, or NULL after the largest.
+ */
+template<class Key, class Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::successor(Node<Key, Value>* current) {
+    if (current != NULL) {
+        if (current->getRight() != NULL) {
+            current = current->getRight();
+            // search the left subtree until hit leaf
+            while (current->getLeft() != NULL) {
+                current = current->getLeft();
+            }
+        }
+        // else go up until current is a left child
+        else {
+            Node<Key, Value>* p = current->getParent();
+            while (p != NULL && p->getRight() == current) {
+                current = p;
+                p = p->getParent();
+            }
+            current = p;
+        }
+    }
+    return current;
+}
+
 /**
  * A method to remove all contents of the tree and
  * reset the values in the tree for use again.
@@ -582,16 +698,32 @@ void BinarySearchTree<Key, Value>::clear() {
     root_ = NULL;
 }
 
+/**
+ * Deletes n's subtree in post-order without recursion or a stack: descend
+ * to a leaf, delete it, unhook it from its parent and carry on from there.
+ * A degenerate tree from sorted input is cleared in O(n) like any other.
+ */
 template<typename Key, typename Value>
 void BinarySearchTree<Key, Value>::clearHelper(Node<Key, Value>* n) {
-
-    if (n->getLeft() != NULL) {
-        clearHelper(n->getLeft());
-    }
-    if (n->getRight() != NULL) {
-        clearHelper(n->getRight());
+    Node<Key, Value>* top = n->getParent();
+    while (n != top) {
+        if (n->getLeft() != NULL) {
+            n = n->getLeft();
+        } else if (n->getRight() != NULL) {
+            n = n->getRight();
+        } else {
+            Node<Key, Value>* p = n->getParent();
+            if (p != top) {
+                if (p->getLeft() == n) {
+                    p->setLeft(NULL);
+                } else {
+                    p->setRight(NULL);
+                }
+            }
+            delete n;
+            n = p;
+        }
     }
-    delete n;
 }
 
 /**
@@ -637,48 +769,43 @@ Node<Key, Value>* BinarySearchTree<Key, Value>::internalFind(const Key& key) con
  */
 template<typename Key, typename Value>
 bool BinarySearchTree<Key, Value>::isBalanced() const {
-    bool b = balHelper(root_);
-    return b;
+    return balHelper(root_) >= 0;
 }
 
+/**
+ * Returns the height of n's subtree (0 if n is NULL), or -1 if some node in
+ * it has children whose heights differ by more than one. One post-order
+ * pass computes every height once; the pending nodes and finished heights
+ * live on heap vectors, so a degenerate tree cannot overflow the call stack.
+ */
 template<typename Key, typename Value>
 int BinarySearchTree<Key, Value>::balHelper(Node<Key, Value>* n) const {
-    // if empty, return true
-    if (n == NULL) {
-        return true;
-    }
-    int lHeight = 0;
-    int rHeight = 0;
+    std::vector<std::pair<Node<Key, Value>*, bool> > todo;  // node, children already pushed
+    std::vector<int> heights;                                // finished subtrees, right on top of left
+    todo.push_back(std::make_pair(n, false));
 
-    // if at least 1 child exists
-    if (n->getLeft() != NULL || n->getRight() != NULL) {
-        if (n->getLeft() != NULL) {
-            lHeight = balHelper(n->getLeft());
-
-            if (lHeight == 0) {
-                return 0;
-            }
-        }
-        if (n->getRight() != NULL) {
-            rHeight = balHelper(n->getRight());
-
-            if (rHeight == 0) {
-                return 0;
-            }
-        }
-    } else {
-        return 1;
-    }
-
-    if (lHeight - rHeight > 1 || rHeight - lHeight > 1) {
-        return false;
-    } else {
-        if (lHeight >= rHeight) {
-            return ++lHeight;
+    while (!todo.empty()) {
+        Node<Key, Value>* x = todo.back().first;
+        if (x == NULL) {
+            todo.pop_back();
+            heights.push_back(0);
+        } else if (!todo.back().second) {
+            todo.back().second = true;
+            todo.push_back(std::make_pair(x->getRight(), false));
+            todo.push_back(std::make_pair(x->getLeft(), false));  // on top, so finished first
         } else {
-            return ++rHeight;
+            todo.pop_back();
+            int rHeight = heights.back();
+            heights.pop_back();
+            int lHeight = heights.back();
+            heights.pop_back();
+            if (lHeight - rHeight > 1 || rHeight - lHeight > 1) {
+                return -1;
+            }
+            heights.push_back(std::max(lHeight, rHeight) + 1);
         }
     }
+    return heights.back();
 }
 
 template<typename Key, typename Value>
@@ -1,12 +1,31 @@
+#include "AdaptiveRadixTree.h"
+#include "ConcurrentAVLTree.h"
+#include "FrontCodedIndex.h"
+#include "FrozenTree.h"
 #include "Hashtable.h"
+#include "HeavyHitters.h"
+#include "HyperLogLog.h"
+#include "LargePages.h"
+#include "PerfCounters.h"
+#include "PersistentAVLTree.h"
+#include "Pipeline.h"
+#include "Tokenizer.h"
 #include "avlbst.h"
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
 #include <ctime>
 #include <fstream>
 #include <iostream>
 #include <locale>
+#include <memory>
+#include <mutex>
 #include <sstream>
+#include <set>
 #include <string>
+#include <thread>
 #include <vector>
 
 using namespace std;
@@ -26,6 +45,416 @@ string process(string s)  // get s into usable form
     return s;
 }
 
+// times count() one word at a time against countBatch() over every word
+void batchBenchmark(const Hashtable& ht, const vector<string>& words, int x, int d, StringArena& arena, ostream& os) {
+    const size_t batchSizes[] = {1, 8, 64, 512, 4096};
+    vector<int> out(words.size());
+    long long check = 0;
+
+    clock_t start = clock();
+    for (size_t j = 0; j < words.size(); j++) {
+        out[j] = ht.count(words[j]);
+    }
+    double scalar = (clock() - start) / (double)CLOCKS_PER_SEC;
+    os << "Batched lookups (seconds per lookup)" << endl;
+    os << "scalar count(): " << scalar / words.size() << endl;
+
+    for (size_t b = 0; b < sizeof(batchSizes) / sizeof(batchSizes[0]); b++) {
+        start = clock();
+        for (size_t j = 0; j < words.size(); j += batchSizes[b]) {
+            size_t num = min(batchSizes[b], words.size() - j);
+            ht.countBatch(&words[j], num, &out[j]);
+        }
+        double batched = (clock() - start) / (double)CLOCKS_PER_SEC;
+        for (size_t j = 0; j < out.size(); j++) {
+            check += out[j];
+        }
+        os << "countBatch() batch " << batchSizes[b] << ": " << batched / words.size() << endl;
+    }
+    os << "(checksum " << check << ")" << endl << endl;
+
+    // the same for inserts, each into a fresh table checked against ht
+    size_t wrong = 0;
+    auto checkTable = [&](const Hashtable& built) {
+        wrong += built.distinct() != ht.distinct();
+        ht.forEach([&](const SmallKey& k, int c) { wrong += built.count(k.str()) != c; });
+    };
+    os << "Batched inserts (seconds per insert)" << endl;
+    {
+        Hashtable fresh(d, x, &arena);
+        start = clock();
+        for (size_t j = 0; j < words.size(); j++) {
+            fresh.add(words[j]);
+        }
+        double scalarAdd = (clock() - start) / (double)CLOCKS_PER_SEC;
+        os << "scalar add(): " << scalarAdd / words.size() << endl;
+        checkTable(fresh);
+    }
+    for (size_t b = 0; b < sizeof(batchSizes) / sizeof(batchSizes[0]); b++) {
+        Hashtable fresh(d, x, &arena);
+        start = clock();
+        for (size_t j = 0; j < words.size(); j += batchSizes[b]) {
+            fresh.addBatch(&words[j], min(batchSizes[b], words.size() - j));
+        }
+        double batched = (clock() - start) / (double)CLOCKS_PER_SEC;
+        os << "addBatch() batch " << batchSizes[b] << ": " << batched / words.size() << endl;
+        checkTable(fresh);
+    }
+    os << "mismatched counts: " << wrong << endl << endl;
+}
+
+// reports how close the sketch's top words and counts are to the exact counts
+void compareSketch(const HeavyHitters& hh, const Hashtable& exact, ostream& os) {
+    vector<pair<int, string> > all;
+    exact.forEach([&](const SmallKey& k, int c) { all.push_back(make_pair(c, k.str())); });
+    sort(all.rbegin(), all.rend());
+
+    vector<pair<string, unsigned long long> > approx = hh.top();
+    set<string> exactTop;
+    for (size_t i = 0; i < approx.size() && i < all.size(); i++) {
+        exactTop.insert(all[i].second);
+    }
+
+    size_t found = 0;
+    double relError = 0;
+    unsigned long long maxOver = 0;
+    for (size_t i = 0; i < approx.size(); i++) {
+        unsigned long long truth = exact.count(approx[i].first);
+        found += exactTop.count(approx[i].first);
+        relError += (double)(approx[i].second - truth) / truth;
+        maxOver = max(maxOver, approx[i].second - truth);
+    }
+
+    os << "Compared with an exact Hashtable of " << all.size() << " distinct words" << endl;
+    os << "Top " << approx.size() << " recall: " << (double)found / exactTop.size() << endl;
+    os << "Mean relative overcount of listed words: " << relError / approx.size() << endl;
+    os << "Largest overcount of a listed word: " << maxOver << endl << endl;
+}
+
+// writes the AVL report formatted by threads threads in order-preserving runs, after timing that against
+// formatting it with the iterator on one thread
+void parallelReport(const AVLTree<SmallKey, int>& a, int threads, ostream& os) {
+    clock_t start = clock();
+    ostringstream one;
+    for (BinarySearchTree<SmallKey, int>::iterator it = a.begin(); it != a.end(); ++it) {
+        one << it->first << " " << it->second << "\n";
+    }
+    double iterSeconds = (clock() - start) / (double)CLOCKS_PER_SEC;
+
+    // a few runs per thread, so a thread finishing early picks up another
+    size_t runs = (size_t)threads * 8;
+    vector<ostringstream> parts(runs);
+    auto wall = chrono::steady_clock::now();
+    a.parallelInOrder(runs, threads, [&](size_t run, const pair<const SmallKey, int>& item) {
+        parts[run] << item.first << " " << item.second << "\n";
+    });
+    double parallelSeconds = chrono::duration<double>(chrono::steady_clock::now() - wall).count();
+
+    os << "Report formatting: iterator " << iterSeconds << " s, parallelInOrder() on " << threads << " threads "
+       << parallelSeconds << " s (wall clock)" << endl
+       << endl;
+    os << "AVLTree" << endl;
+    for (size_t i = 0; i < runs; i++) {
+        os << parts[i].str();
+    }
+}
+
+// times threads readers looking up every word in the AVL tree behind one mutex, then in a ConcurrentAVLTree
+void readersBenchmark(const AVLTree<SmallKey, int>& a, const vector<string>& words, int threads, ostream& os) {
+    ConcurrentAVLTree<SmallKey, int> c;
+    for (BinarySearchTree<SmallKey, int>::iterator it = a.begin(); it != a.end(); ++it) {
+        c.insert(*it);
+    }
+
+    mutex lock;
+    atomic<long long> check(0);
+    auto timeReaders = [&](bool concurrent) {
+        auto wall = chrono::steady_clock::now();
+        vector<thread> readers;
+        for (int t = 0; t < threads; t++) {
+            readers.push_back(thread([&]() {
+                long long sum = 0;
+                for (size_t j = 0; j < words.size(); j++) {
+                    SmallKey k = SmallKey::view(words[j]);
+                    int v = 0;
+                    if (concurrent) {
+                        c.find(k, v);
+                    } else {
+                        lock_guard<mutex> hold(lock);
+                        v = a.find(k)->second;
+                    }
+                    sum += v;
+                }
+                check += sum;
+            }));
+        }
+        for (int t = 0; t < threads; t++) {
+            readers[t].join();
+        }
+        return chrono::duration<double>(chrono::steady_clock::now() - wall).count();
+    };
+    double locked = timeReaders(false);
+    double concurrent = timeReaders(true);
+
+    double lookups = (double)words.size() * threads;
+    os << threads << " reader threads (" << thread::hardware_concurrency() << " cores)" << endl;
+    os << "AVLTree behind a mutex: " << lookups / locked << " lookups/s" << endl;
+    os << "ConcurrentAVLTree: " << lookups / concurrent << " lookups/s" << endl;
+    os << "(checksum " << check << ")" << endl << endl;
+}
+
+// counts words in shards separate tables, then times merging them one at a time against mergeAll()
+bool mergeBenchmark(const Hashtable& whole, const vector<string>& words, int x, int d, int shards, StringArena& arena,
+                    bool hugePages, ostream& os) {
+    vector<unique_ptr<Hashtable> > parts;
+    for (int s = 0; s < shards; s++) {
+        parts.push_back(unique_ptr<Hashtable>(new Hashtable(d, x, &arena, hugePages)));
+        size_t from = words.size() * s / shards;
+        size_t to = words.size() * (s + 1) / shards;
+        for (size_t j = from; j < to; j++) {
+            parts[s]->add(words[j]);
+        }
+    }
+
+    clock_t start = clock();
+    Hashtable pairwise(d, x, &arena, hugePages);
+    for (int s = 0; s < shards; s++) {
+        pairwise.merge(*parts[s]);
+    }
+    double pairSeconds = (clock() - start) / (double)CLOCKS_PER_SEC;
+
+    vector<const Hashtable*> others;
+    for (int s = 0; s < shards; s++) {
+        others.push_back(parts[s].get());
+    }
+    Hashtable kway(d, x, &arena, hugePages);
+    auto wall = chrono::steady_clock::now();
+    kway.mergeAll(others);
+    double kwaySeconds = chrono::duration<double>(chrono::steady_clock::now() - wall).count();
+
+    size_t wrong = 0;
+    whole.forEach([&](const SmallKey& k, int c) {
+        wrong += pairwise.count(k.str()) != c;
+        wrong += kway.count(k.str()) != c;
+    });
+    wrong += pairwise.distinct() != whole.distinct();
+    wrong += kway.distinct() != whole.distinct();
+
+    os << "Merging " << shards << " shards (" << thread::hardware_concurrency() << " threads for mergeAll)" << endl;
+    os << "merge() one at a time: " << pairSeconds << " s" << endl;
+    os << "mergeAll() wall clock: " << kwaySeconds << " s" << endl;
+    os << "mismatched counts: " << wrong << endl << endl;
+    return wrong == 0;
+}
+
+// counts words into a table on ordinary pages and one on huge pages, and compares their page faults and TLB misses
+void pagesBenchmark(const vector<string>& words, int x, int d, StringArena& arena, ostream& os) {
+    os << "Huge pages (" << numaNodes() << " NUMA nodes)" << endl;
+    long long check = 0;
+    for (int huge = 0; huge < 2; huge++) {
+        size_t thpBefore = anonHugeBytes();
+        Hashtable ht(d, x, &arena, huge == 1);
+        PerfCounters counters;
+        counters.addPageFaults();
+        counters.addDTLBMisses();
+
+        counters.start();
+        clock_t start = clock();
+        for (size_t j = 0; j < words.size(); j++) {
+            ht.add(words[j]);
+        }
+        double addSeconds = (clock() - start) / (double)CLOCKS_PER_SEC;
+        counters.stop();
+        os << (huge ? "huge pages" : "ordinary pages") << ", " << ht.bytes() << " bytes, "
+           << (anonHugeBytes() - thpBefore) / kHugePage << " transparent huge pages" << endl;
+        os << "add(): " << addSeconds / words.size() << " s per operation" << endl;
+        counters.report(os, (double)words.size());
+
+        counters.start();
+        start = clock();
+        for (size_t j = 0; j < words.size(); j++) {
+            check += huge ? -ht.count(words[j]) : ht.count(words[j]);
+        }
+        double countSeconds = (clock() - start) / (double)CLOCKS_PER_SEC;
+        counters.stop();
+        os << "count(): " << countSeconds / words.size() << " s per operation" << endl;
+        counters.report(os, (double)words.size());
+    }
+    os << "(checksum " << check << ")" << endl << endl;
+}
+
+// lists the words starting with prefix found by prefix_scan(), and times that against a walk from begin()
+void prefixBenchmark(const AVLTree<SmallKey, int>& a, const string& prefix, ostream& os) {
+    SmallKey pre = SmallKey::view(prefix);
+    size_t walked = 0;
+    clock_t start = clock();
+    for (BinarySearchTree<SmallKey, int>::iterator it = a.begin(); it != a.end(); ++it) {
+        walked += keyHasPrefix(it->first, pre);
+    }
+    double walkSeconds = (clock() - start) / (double)CLOCKS_PER_SEC;
+
+    start = clock();
+    pair<BinarySearchTree<SmallKey, int>::iterator, BinarySearchTree<SmallKey, int>::iterator> range
+            = a.prefix_scan(pre);
+    size_t scanned = 0;
+    for (BinarySearchTree<SmallKey, int>::iterator it = range.first; it != range.second; ++it) {
+        scanned++;
+    }
+    double scanSeconds = (clock() - start) / (double)CLOCKS_PER_SEC;
+
+    os << "Words starting with \"" << prefix << "\": " << scanned << " (" << walked << " by a full walk)" << endl;
+    os << "prefix_scan(): " << scanSeconds << " s, walk from begin(): " << walkSeconds << " s" << endl;
+    for (BinarySearchTree<SmallKey, int>::iterator it = range.first; it != range.second; ++it) {
+        os << it->first << " " << it->second << endl;
+    }
+    os << endl;
+}
+
+// saves a frozen copy of ht to path, maps it back, checks every count and times count() on both
+bool freezeBenchmark(const Hashtable& ht, const vector<string>& words, const char* path, ostream& os) {
+    clock_t start = clock();
+    FrozenTable built = ht.freeze();
+    double buildSeconds = (clock() - start) / (double)CLOCKS_PER_SEC;
+    FrozenTable frozen;
+    if (!built.save(path) || !frozen.open(path)) {
+        os << "Could not save and map the frozen table at " << path << endl << endl;
+        return false;
+    }
+
+    size_t wrong = 0;
+    ht.forEach([&](const SmallKey& k, int c) { wrong += frozen.count(k.str()) != c; });
+    wrong += frozen.count("0") != 0;  // never a word, the tokenizer keeps letters only
+
+    long long check = 0;
+    start = clock();
+    for (size_t j = 0; j < words.size(); j++) {
+        check += ht.count(words[j]);
+    }
+    double probed = (clock() - start) / (double)CLOCKS_PER_SEC;
+    start = clock();
+    for (size_t j = 0; j < words.size(); j++) {
+        check -= frozen.count(words[j]);
+    }
+    double perfect = (clock() - start) / (double)CLOCKS_PER_SEC;
+
+    os << "Frozen perfect hash table (" << path << ")" << endl;
+    os << "build: " << buildSeconds << " s, " << frozen.size() << " words" << endl;
+    os << "bytes: " << frozen.bytes() << " frozen, " << ht.bytes() << " hashtable" << endl;
+    os << "seconds per lookup: " << perfect / words.size() << " frozen, " << probed / words.size() << " hashtable"
+       << endl;
+    os << "mismatched counts: " << wrong << " (checksum " << check << ")" << endl << endl;
+    return wrong == 0;
+}
+
+// the same check and timing for the AVL tree's FrozenTree
+bool freezeTreeBenchmark(const AVLTree<SmallKey, int>& a, const vector<string>& words, const char* path, ostream& os) {
+    clock_t start = clock();
+    FrozenTree built = freeze(a);
+    double buildSeconds = (clock() - start) / (double)CLOCKS_PER_SEC;
+    FrozenTree frozen;
+    if (!built.save(path) || !frozen.open(path)) {
+        os << "Could not save and map the frozen tree at " << path << endl << endl;
+        return false;
+    }
+
+    size_t wrong = 0;
+    size_t nodes = 0;
+    for (AVLTree<SmallKey, int>::iterator it = a.begin(); it != a.end(); ++it) {
+        wrong += frozen.count(it->first.str()) != it->second;
+        nodes++;
+    }
+    wrong += frozen.count("0") != 0;  // never a word, the tokenizer keeps letters only
+
+    long long check = 0;
+    start = clock();
+    for (size_t j = 0; j < words.size(); j++) {
+        check += a.find(SmallKey::view(words[j]))->second;
+    }
+    double tree = (clock() - start) / (double)CLOCKS_PER_SEC;
+    start = clock();
+    for (size_t j = 0; j < words.size(); j++) {
+        check -= frozen.count(words[j]);
+    }
+    double flat = (clock() - start) / (double)CLOCKS_PER_SEC;
+
+    os << "Frozen Eytzinger tree (" << path << ")" << endl;
+    os << "build: " << buildSeconds << " s, " << frozen.size() << " words" << endl;
+    os << "bytes: " << frozen.bytes() << " frozen, " << nodes * sizeof(AVLNode<SmallKey, int>) << " AVL nodes" << endl;
+    os << "seconds per lookup: " << flat / words.size() << " frozen, " << tree / words.size() << " AVLTree" << endl;
+    os << "mismatched counts: " << wrong << " (checksum " << check << ")" << endl << endl;
+    return wrong == 0;
+}
+
+// builds a FrontCodedIndex of the sorted words and checks and times it against the structure they came from
+template<typename Count>
+bool frontCodedBenchmark(const vector<pair<string, int> >& sorted, const vector<string>& words, size_t structureBytes,
+                         const char* name, Count count, ostream& os) {
+    clock_t start = clock();
+    FrontCodedIndex index = FrontCodedIndex::build(sorted);
+    double buildSeconds = (clock() - start) / (double)CLOCKS_PER_SEC;
+
+    size_t wrong = 0;
+    size_t j = 0;
+    for (FrontCodedIndex::iterator it = index.begin(); it != index.end(); ++it, ++j) {
+        wrong += j >= sorted.size() || *it != sorted[j];
+    }
+    wrong += j != sorted.size();
+    wrong += index.count("0") != 0;  // never a word, the tokenizer keeps letters only
+
+    long long check = 0;
+    start = clock();
+    for (j = 0; j < words.size(); j++) {
+        check += count(words[j]);
+    }
+    double original = (clock() - start) / (double)CLOCKS_PER_SEC;
+    start = clock();
+    for (j = 0; j < words.size(); j++) {
+        check -= index.count(words[j]);
+    }
+    double coded = (clock() - start) / (double)CLOCKS_PER_SEC;
+
+    size_t keyBytes = 0;
+    for (j = 0; j < sorted.size(); j++) {
+        keyBytes += sorted[j].first.length();
+    }
+    os << "Front coded index, " << FrontCodedIndex::kBlock << " words a block" << endl;
+    os << "build: " << buildSeconds << " s, " << index.size() << " words, " << keyBytes << " bytes of words" << endl;
+    os << "bytes: " << index.bytes() << " front coded, " << structureBytes << " " << name << endl;
+    os << "seconds per lookup: " << coded / words.size() << " front coded, " << original / words.size() << " "
+       << name << endl;
+    os << "mismatches: " << wrong << " (checksum " << check << ")" << endl << endl;
+    return wrong == 0;
+}
+
+const size_t kBlockSize = 64 * 1024;  // bytes read at a time in --stream mode
+
+// tokenizes path ("-" for stdin) one block at a time, calling countWord on each word,
+// returns the number of words
+template<typename CountWord>
+size_t streamWords(const char* path, CountWord countWord) {
+    FILE* in = string(path) == "-" ? stdin : fopen(path, "rb");
+    if (in == NULL) {
+        return 0;
+    }
+    vector<char> block(kBlockSize);
+    Tokenizer tokens;
+    size_t num = 0;
+    auto emit = [&](const string& w) {
+        countWord(w);
+        num++;
+    };
+
+    size_t got;
+    while ((got = fread(&block[0], 1, block.size(), in)) > 0) {
+        tokens.feed(&block[0], got, emit);
+    }
+    tokens.finish(emit);
+    if (in != stdin) {
+        fclose(in);
+    }
+    return num;
+}
+
 int main(int argc, char** argv) {
     clock_t start;
     double duration = 0;
@@ -35,23 +464,115 @@ int main(int argc, char** argv) {
         return -1;
     }
 
-    ifstream ifile(argv[1]);
-    if (ifile.fail()) {
-        cout << "No input file opened" << endl;
+    int x = atoi(argv[3]);  // probe type
+    int d = atoi(argv[4]);  // debug mode?
+    int r = atoi(argv[5]);  // repeat num
+    bool batch = false;     // --batch: benchmark countBatch() against count()
+    bool stream = false;    // --stream: count block by block instead of loading every word
+    bool pipe = false;      // --pipeline: --stream with reading, tokenizing and counting on 3 threads
+    bool compare = false;   // --compare: check the heavy hitters against exact counts
+    size_t topK = 100;      // --topk: words kept by the heavy hitters summary
+    double eps = 0.0001;    // --eps: sketch error as a fraction of all words
+    double delta = 0.01;    // --delta: chance an estimate exceeds that error
+    bool hll = false;       // --hll: estimate the distinct words first and presize the hashtable
+    const char* freezePath = NULL;  // --freeze: save a perfect hash copy of the final table there
+    int shards = 0;         // --shards: count in this many pieces and merge them
+    string prefix;          // --prefix: list the AVL tree's words starting with it
+    int readers = 0;        // --readers: threads looking up every word at once
+    bool persistent = false;  // --persistent: count in a PersistentAVLTree and report a snapshot mid-count
+    int reportThreads = 0;  // --report-threads: format the AVL report on this many threads
+    bool frontCoded = false;  // --front-coded: compress the sorted words into a FrontCodedIndex
+    bool hugePages = false;  // --huge-pages: map big hashtable arrays on huge pages
+    bool perf = false;      // --perf: hardware counters per operation over the timed iterations
+    int bulk = 0;           // --bulk: add words to the AVL tree in batches of this many with insert_bulk()
+    bool hasPrefix = false;
+
+    // optional flags after the positional arguments
+    for (int i = 6; i < argc; i++) {
+        string flag = argv[i];
+        if (flag == "--batch") {
+            batch = true;
+        } else if (flag == "--stream") {
+            stream = true;
+        } else if (flag == "--pipeline") {
+            stream = true;
+            pipe = true;
+        } else if (flag == "--hll") {
+            hll = true;
+        } else if (flag == "--compare") {
+            compare = true;
+        } else if (flag == "--freeze" && i + 1 < argc) {
+            freezePath = argv[++i];
+        } else if (flag == "--shards" && i + 1 < argc) {
+            shards = atoi(argv[++i]);
+        } else if (flag == "--prefix" && i + 1 < argc) {
+            prefix = process(argv[++i]);
+            hasPrefix = true;
+        } else if (flag == "--persistent") {
+            persistent = true;
+        } else if (flag == "--report-threads" && i + 1 < argc) {
+            reportThreads = atoi(argv[++i]);
+        } else if (flag == "--perf") {
+            perf = true;
+        } else if (flag == "--huge-pages") {
+            hugePages = true;
+        } else if (flag == "--front-coded") {
+            frontCoded = true;
+        } else if (flag == "--bulk" && i + 1 < argc) {
+            bulk = atoi(argv[++i]);
+        } else if (flag == "--readers" && i + 1 < argc) {
+            readers = atoi(argv[++i]);
+        } else if (flag == "--topk" && i + 1 < argc) {
+            topK = atoi(argv[++i]);
+        } else if (flag == "--eps" && i + 1 < argc) {
+            eps = atof(argv[++i]);
+        } else if (flag == "--delta" && i + 1 < argc) {
+            delta = atof(argv[++i]);
+        } else {
+            cout << "Unknown option " << flag << endl;
+            return -1;
+        }
+    }
+
+    bool fromStdin = string(argv[1]) == "-";
+    if (fromStdin && !stream) {
+        cout << "Reading stdin needs --stream" << endl;
+        return -1;
+    }
+    if (fromStdin && (r != 1 || compare)) {
+        cout << "stdin can only be read once, use 1 iteration and no --compare" << endl;
+        return -1;
+    }
+    if (stream && (batch || freezePath != NULL || shards > 0 || readers > 0 || persistent || frontCoded)) {
+        cout << "--batch, --freeze, --shards, --readers, --persistent and --front-coded need the words in memory, they "
+                "cannot be used with --stream"
+             << endl;
+        return -1;
+    }
+    if (persistent && (readers > 0 || hasPrefix || reportThreads > 0 || bulk > 0 || freezePath != NULL || frontCoded)) {
+        cout << "--readers, --prefix, --report-threads, --bulk, --freeze and --front-coded run on the AVLTree, not with "
+                "--persistent"
+             << endl;
         return -1;
     }
 
+    ifstream ifile;
+    if (!fromStdin) {
+        ifile.open(argv[1]);
+        if (ifile.fail()) {
+            cout << "No input file opened" << endl;
+            return -1;
+        }
+    }
+
     ofstream ofile(argv[2]);
-    int x = atoi(argv[3]);  // probe type
-    int d = atoi(argv[4]);  // debug mode?
-    int r = atoi(argv[5]);  // repeat num
     vector<string> words;
     stringstream ss;
     string line = "";
     string buf = "";
 
     // store all input words in words vector
-    while (getline(ifile, line)) {
+    while (!stream && getline(ifile, line)) {
         if (line.length() == 0) {
             continue;
         }
@@ -68,29 +589,142 @@ int main(int argc, char** argv) {
 
     // DONE PROCESSING
 
+    // long keys are interned once and shared by every iteration's table or tree,
+    // short ones are stored in the slot/node
+    StringArena arena;
+
+    size_t numWords = words.size();
+    PipelineStats stages;
+    bool avl = x == 3;     // AVLTree instead of a hashtable
+    bool sketch = x == 6;  // approximate heavy hitters instead of exact counts
+    bool art = x == 7;     // adaptive radix tree instead of a hashtable
+    bool hashtable = !avl && !sketch && !art;
+
+    // stdin cannot be read twice, so there the estimate is made alongside the count
+    HyperLogLog distinct;
+    bool hllAlongside = hll && fromStdin;
+    int presize = 0;
+    double hllSeconds = 0;
+    if (hll && !fromStdin) {
+        start = clock();
+        auto estimateWord = [&](const string& w) { distinct.add(w); };
+        if (stream) {
+            streamWords(argv[1], estimateWord);
+        } else {
+            for (unsigned int j = 0; j < words.size(); j++) {
+                estimateWord(words[j]);
+            }
+        }
+        hllSeconds = (clock() - start) / (double)CLOCKS_PER_SEC;
+        // pad by 3 standard errors so an underestimate rarely costs a final resize
+        presize = (int)ceil(distinct.estimate() * (1 + 3 * distinct.standardError()));
+    }
+
+    PerfCounters counters;
+    if (perf) {
+        counters.addStandard();
+        counters.start();
+    }
     start = clock();
     for (int i = 0; i < r; i++) {
         // reinstatiate every iterations
-        Hashtable myHT(d, x);
-        AVLTree<string, int> a;
+        Hashtable myHT(d, x, &arena, hugePages);
+        AVLTree<SmallKey, int> a;
+        PersistentAVLTree<SmallKey, int> pa;
+        AdaptiveRadixTree radix;
+        HeavyHitters hh(sketch ? topK : 1, sketch ? eps : 1, delta);
+        vector<string> pending;  // --bulk words not yet in a, interned only if a lacks them
+        if (presize > 0 && hashtable) {
+            myHT.reserve(presize);  // skips the resize ladder
+        }
 
-        if (x != 3) {
-            for (unsigned int j = 0; j < words.size(); j++) {
-                myHT.add(words[j]);
+        // hands pending to a as views; the arena copies just the keys a is missing
+        auto flushBulk = [&]() {
+            vector<pair<SmallKey, int> > batch;
+            batch.reserve(pending.size());
+            for (size_t k = 0; k < pending.size(); k++) {
+                batch.push_back(make_pair(SmallKey::view(pending[k]), 1));
             }
-        } else {
-            for (unsigned int j = 0; j < words.size(); j++) {
-                AVLTree<string, int>::iterator it = a.find(words[j]);
+            a.insert_bulk(batch.begin(), batch.end(), 0, [&](const SmallKey& k) {
+                return SmallKey(k.data(), k.size(), arena);
+            });
+            pending.clear();
+        };
+
+        // adds one occurrence of w to the structure being timed
+        auto countWord = [&](const string& w) {
+            if (hllAlongside) {
+                distinct.add(w);
+            }
+            if (sketch) {
+                hh.add(w);
+            } else if (art) {
+                radix.add(w);
+            } else if (!avl) {
+                myHT.add(w);
+            } else if (persistent) {
+                const int* c = pa.find(SmallKey::view(w));
+                if (c != NULL)
+                    pa.insert(make_pair(SmallKey::view(w), *c + 1));  // an existing key keeps its stored copy
+                else
+                    pa.insert(make_pair(SmallKey(w, arena), 1));
+            } else if (bulk > 0) {
+                pending.push_back(w);
+                if ((int)pending.size() == bulk) {
+                    flushBulk();
+                }
+            } else {
+                AVLTree<SmallKey, int>::iterator it = a.find(SmallKey::view(w));
                 if (it != a.end())
-                    a.insert(make_pair(words[j], it->second + 1));
+                    it->second++;
                 else
-                    a.insert(make_pair(words[j], 1));
+                    a.insert(make_pair(SmallKey(w, arena), 1));
+            }
+        };
+
+        if (pipe) {
+            stages = PipelineStats();
+            if (!runPipeline(argv[1], countWord, stages)) {
+                cout << "Could not read " << argv[1] << endl;
+                return -1;
+            }
+            numWords = stages.words;
+        } else if (stream) {
+            // memory stays at the vocabulary plus one block, the timing includes reading
+            numWords = streamWords(argv[1], countWord);
+        } else {
+            thread dump;
+            string snapshotPath = string(argv[2]) + ".snapshot";
+            for (unsigned int j = 0; j < words.size(); j++) {
+                if (persistent && i == r - 1 && j == words.size() / 2) {
+                    // the report of the first half is written while the second half is counted
+                    PersistentAVLTree<SmallKey, int> half = pa.snapshot();
+                    dump = thread([half, snapshotPath, j]() {
+                        ofstream out(snapshotPath.c_str());
+                        out << "PersistentAVLTree snapshot after " << j << " words" << endl;
+                        half.forEach([&](const SmallKey& k, int c) { out << k << " " << c << endl; });
+                    });
+                }
+                countWord(words[j]);
+            }
+            if (dump.joinable()) {
+                dump.join();
             }
         }
+        if (!pending.empty()) {
+            flushBulk();
+        }
         // output results for human readability
         if (i == r - 1) {
             duration = (clock() - start) / (double)CLOCKS_PER_SEC;
-            if (x != 3) {
+            if (perf) {
+                counters.stop();
+            }
+            if (sketch) {
+                ofile << "Count-Min Sketch + Space-Saving heavy hitters" << endl;
+            } else if (art) {
+                ofile << "Adaptive radix tree" << endl;
+            } else if (!avl) {
                 ofile << "Hashtable with ";
                 if (x == 0)
                     ofile << "linear probing" << endl;
@@ -98,20 +732,113 @@ int main(int argc, char** argv) {
                     ofile << "quadratic probing" << endl;
                 else if (x == 2)
                     ofile << "double hashing" << endl;
+                else if (x == 4)
+                    ofile << "robin hood hashing" << endl;
+                else if (x == 5)
+                    ofile << "swiss table group probing" << endl;
+                else if (x == 8)
+                    ofile << "bucketized cuckoo hashing" << endl;
             } else {
-                ofile << "AVLTree" << endl;
+                ofile << (persistent ? "PersistentAVLTree" : "AVLTree") << endl;
             }
-            ofile << words.size() << " words" << endl;
+            ofile << numWords << " words" << endl;
             ofile << "ALL TIMES ARE IN SECONDS" << endl;
             ofile << "Time for r iterations: " << duration << endl;
             ofile << "Per iteration (average): " << duration / r << endl;
-            ofile << "Per operation: " << (duration / r) / words.size() << endl << endl;
+            ofile << "Per operation: " << (duration / r) / numWords << endl << endl;
+
+            if (perf) {
+                ofile << "Performance counters over all " << r << " iterations" << endl;
+                counters.report(ofile, (double)numWords * r);
+                ofile << endl;
+            }
+
+            if (pipe) {
+                stages.report(ofile);
+            }
+            if (hll) {
+                ofile << "HyperLogLog estimate: " << distinct.estimate() << " distinct words (standard error "
+                      << distinct.standardError() * 100 << "%, " << distinct.bytes() << " bytes)" << endl;
+                if (!hllAlongside) {
+                    ofile << "Estimate pass: " << hllSeconds << ", hashtable presized for " << presize << " words"
+                          << endl;
+                }
+                if (hashtable) {
+                    ofile << "Actual distinct words: " << myHT.distinct() << endl;
+                }
+                ofile << endl;
+            }
+            if (batch && hashtable) {
+                batchBenchmark(myHT, words, x, d, arena, ofile);
+            }
+            if (readers > 0 && avl) {
+                readersBenchmark(a, words, readers, ofile);
+            }
+            if (hasPrefix && avl) {
+                prefixBenchmark(a, prefix, ofile);
+            }
+            if (shards > 0 && hashtable) {
+                mergeBenchmark(myHT, words, x, d, shards, arena, hugePages, ofile);
+            }
+            if (hugePages && hashtable && !stream) {
+                pagesBenchmark(words, x, d, arena, ofile);
+            }
+            if (freezePath != NULL && hashtable) {
+                freezeBenchmark(myHT, words, freezePath, ofile);
+            }
+            if (freezePath != NULL && avl) {
+                freezeTreeBenchmark(a, words, freezePath, ofile);
+            }
+            if (frontCoded && !sketch) {
+                vector<pair<string, int> > sorted;
+                if (avl) {
+                    for (AVLTree<SmallKey, int>::iterator it = a.begin(); it != a.end(); ++it) {
+                        sorted.push_back(make_pair(it->first.str(), it->second));
+                    }
+                    size_t nodeBytes = sorted.size() * sizeof(AVLNode<SmallKey, int>);
+                    frontCodedBenchmark(sorted, words, nodeBytes, "AVLTree",
+                                        [&](const string& w) { return a.find(SmallKey::view(w))->second; }, ofile);
+                } else if (art) {
+                    radix.forEach([&](const string& k, int c) { sorted.push_back(make_pair(k, c)); });
+                    frontCodedBenchmark(sorted, words, radix.bytes(), "adaptive radix tree",
+                                        [&](const string& w) { return radix.count(w); }, ofile);
+                } else {
+                    myHT.forEach([&](const SmallKey& k, int c) { sorted.push_back(make_pair(k.str(), c)); });
+                    sort(sorted.begin(), sorted.end());
+                    frontCodedBenchmark(sorted, words, myHT.bytes(), "Hashtable",
+                                        [&](const string& w) { return myHT.count(w); }, ofile);
+                }
+            }
+            if (compare && sketch) {
+                // exact counts for reference, built after the timing stopped
+                Hashtable exact(false, 5, &arena);
+                auto countExact = [&](const string& w) { exact.add(w); };
+                if (stream) {
+                    streamWords(argv[1], countExact);
+                } else {
+                    for (unsigned int j = 0; j < words.size(); j++) {
+                        countExact(words[j]);
+                    }
+                }
+                compareSketch(hh, exact, ofile);
+            }
 
-            if (x != 3)
+            if (sketch)
+                hh.reportAll(ofile);
+            else if (art) {
+                ofile << "Adaptive radix tree, " << radix.size() << " words, " << radix.bytes() << " bytes of nodes"
+                      << endl;
+                radix.forEach([&](const string& k, int c) { ofile << k << " " << c << endl; });
+            } else if (!avl)
                 myHT.reportAll(ofile);
-            else {
+            else if (persistent) {
+                ofile << "PersistentAVLTree (first half's snapshot in " << argv[2] << ".snapshot)" << endl;
+                pa.forEach([&](const SmallKey& k, int c) { ofile << k << " " << c << endl; });
+            } else if (reportThreads > 0) {
+                parallelReport(a, reportThreads, ofile);
+            } else {
                 ofile << "AVLTree" << endl;
-                for (BinarySearchTree<string, int>::iterator it = a.begin(); it != a.end(); ++it) 
+                for (BinarySearchTree<SmallKey, int>::iterator it = a.begin(); it != a.end(); ++it) 
                 {
                     ofile << it->first << " " << it->second << endl;
                 }